@@ -0,0 +1,330 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "assetbundle.h"
+#include "logging.h"
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QRegExp>
+#include <QStringList>
+#include <QMimeDatabase>
+#include <QTimer>
+#include <QtEndian>
+#include <string.h>
+
+#define ASSETBUNDLE_MAGIC "PCAB"
+#define ASSETBUNDLE_FORMAT 1
+#define ASSETBUNDLE_CHUNK 1048576
+
+static void appendU16(QByteArray &ba, quint16 v) {
+    uchar buf[2];
+    qToBigEndian<quint16>(v, buf);
+    ba.append((const char *)buf, 2);
+}
+
+static void appendU32(QByteArray &ba, quint32 v) {
+    uchar buf[4];
+    qToBigEndian<quint32>(v, buf);
+    ba.append((const char *)buf, 4);
+}
+
+static void appendU64(QByteArray &ba, quint64 v) {
+    uchar buf[8];
+    qToBigEndian<quint64>(v, buf);
+    ba.append((const char *)buf, 8);
+}
+
+AssetBundle::AssetBundle() {
+    m_map = NULL;
+    m_size = 0;
+}
+
+AssetBundle::~AssetBundle() {
+    if (m_map) m_file.unmap(m_map);
+}
+
+QString AssetBundle::versionFromDir(QString src_dir_abs) {
+    QFile f(src_dir_abs + "/js/version.js");
+    if (!f.open(QIODevice::ReadOnly)) return "";
+    QString str = QString::fromUtf8(f.readAll());
+    QRegExp rx("assets_version = ['\"](.+)[\"']");
+    rx.setMinimal(true);
+    if (rx.indexIn(str) < 0) return "";
+    return rx.cap(1);
+}
+
+/* Compares dotted version strings numerically, component by component.
+ */
+int AssetBundle::compareVersions(QString a, QString b) {
+    QStringList pa = a.split(".");
+    QStringList pb = b.split(".");
+    for (int i = 0; i < qMax(pa.length(), pb.length()); i++) {
+        int va = i < pa.length() ? pa.at(i).toInt() : 0;
+        int vb = i < pb.length() ? pb.at(i).toInt() : 0;
+        if (va != vb) return va < vb ? -1 : 1;
+    }
+    return 0;
+}
+
+bool AssetBundle::pack(QString src_dir_abs, QString bundle_abs, QString *error) {
+    QDir src(src_dir_abs);
+    if (!src.exists()) {
+        *error = "srcNotExisting";
+        return false;
+    }
+    QString version = versionFromDir(src_dir_abs);
+    if (version == "") {
+        *error = "versionNotFound";
+        return false;
+    }
+
+    QStringList names;
+    QList<qint64> sizes;
+    QDirIterator it(src.absolutePath(), QDir::Files | QDir::Hidden | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        it.next();
+        names.append(it.filePath().mid(src.absolutePath().length() + 1));
+    }
+    names.sort();
+
+    QByteArray version_utf8 = version.toUtf8();
+    qint64 header_size = 4 + 4 + 2 + version_utf8.length() + 4;
+    foreach (QString name, names) {
+        header_size += 2 + name.toUtf8().length() + 8 + 8;
+        sizes.append(QFileInfo(src.absolutePath() + "/" + name).size());
+    }
+
+    QByteArray header;
+    header.append(ASSETBUNDLE_MAGIC, 4);
+    appendU32(header, ASSETBUNDLE_FORMAT);
+    appendU16(header, version_utf8.length());
+    header.append(version_utf8);
+    appendU32(header, names.length());
+    qint64 offset = header_size;
+    for (int i = 0; i < names.length(); i++) {
+        QByteArray name = names.at(i).toUtf8();
+        appendU16(header, name.length());
+        header.append(name);
+        appendU64(header, offset);
+        appendU64(header, sizes.at(i));
+        offset += sizes.at(i);
+    }
+
+    QString part_abs = bundle_abs + ".part";
+    QFile out(part_abs);
+    if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        *error = "cannotOpen";
+        return false;
+    }
+    out.write(header);
+    for (int i = 0; i < names.length(); i++) {
+        QFile in(src.absolutePath() + "/" + names.at(i));
+        if (!in.open(QIODevice::ReadOnly)) {
+            out.close();
+            out.remove();
+            *error = "cannotRead " + names.at(i);
+            return false;
+        }
+        qint64 remaining = sizes.at(i);
+        while (remaining > 0) {
+            QByteArray chunk = in.read(qMin(remaining, (qint64)ASSETBUNDLE_CHUNK));
+            if (chunk.isEmpty()) break;
+            out.write(chunk);
+            remaining -= chunk.length();
+        }
+        if (remaining != 0) {
+            out.close();
+            out.remove();
+            *error = "changedWhilePacking " + names.at(i);
+            return false;
+        }
+    }
+    out.close();
+
+    QFile::remove(bundle_abs);
+    if (!QFile::rename(part_abs, bundle_abs)) {
+        *error = "cannotRename";
+        return false;
+    }
+    PLOG(lcFs, 0) << "[AssetBundle::pack]" << bundle_abs << version << names.length() << "files";
+    return true;
+}
+
+/* Reads only the header, for choosing between bundles.
+ */
+QString AssetBundle::readVersion(QString bundle_abs) {
+    QFile f(bundle_abs);
+    if (!f.open(QIODevice::ReadOnly)) return "";
+    QByteArray head = f.read(10);
+    if (head.length() < 10 || !head.startsWith(ASSETBUNDLE_MAGIC)) return "";
+    if (qFromBigEndian<quint32>((const uchar *)head.constData() + 4) != ASSETBUNDLE_FORMAT) return "";
+    quint16 length = qFromBigEndian<quint16>((const uchar *)head.constData() + 8);
+    return QString::fromUtf8(f.read(length));
+}
+
+bool AssetBundle::open(QString bundle_abs) {
+    m_file.setFileName(bundle_abs);
+    if (!m_file.open(QIODevice::ReadOnly)) return false;
+    m_size = m_file.size();
+    m_map = m_file.map(0, m_size);
+    if (!m_map) return false;
+
+    const uchar *p = m_map;
+    qint64 pos = 0;
+    if (m_size < 14 || memcmp(p, ASSETBUNDLE_MAGIC, 4) != 0) return false;
+    if (qFromBigEndian<quint32>(p + 4) != ASSETBUNDLE_FORMAT) return false;
+    quint16 version_len = qFromBigEndian<quint16>(p + 8);
+    pos = 10;
+    if (pos + version_len + 4 > m_size) return false;
+    m_version = QString::fromUtf8((const char *)p + pos, version_len);
+    pos += version_len;
+    quint32 count = qFromBigEndian<quint32>(p + pos);
+    pos += 4;
+
+    m_index.clear();
+    m_index.reserve((int)qMin((qint64)count, m_size / 18));
+    for (quint32 i = 0; i < count; i++) {
+        if (pos + 2 > m_size) return false;
+        quint16 name_len = qFromBigEndian<quint16>(p + pos);
+        if (pos + 2 + name_len + 16 > m_size) return false;
+        QString name = QString::fromUtf8((const char *)p + pos + 2, name_len);
+        pos += 2 + name_len;
+        qint64 offset = qFromBigEndian<quint64>(p + pos);
+        qint64 size = qFromBigEndian<quint64>(p + pos + 8);
+        pos += 16;
+        // by subtraction, so that values from the file cannot overflow the check
+        if (offset < 0 || size < 0 || offset > m_size || size > m_size - offset) return false;
+        m_index.insert(name, qMakePair(offset, size));
+    }
+    PLOG(lcFs, 1) << "[AssetBundle::open]" << bundle_abs << m_version << count << "files";
+    return true;
+}
+
+QString AssetBundle::version() {
+    return m_version;
+}
+
+QString AssetBundle::path() {
+    return m_file.fileName();
+}
+
+bool AssetBundle::contains(QString name) {
+    return m_index.contains(name);
+}
+
+/* The returned QByteArray points into the mapped file and is only valid
+ * as long as the bundle exists.
+ */
+QByteArray AssetBundle::data(QString name) {
+    QPair<qint64, qint64> entry = m_index.value(name, qMakePair((qint64)-1, (qint64)0));
+    if (entry.first < 0) return QByteArray();
+    return QByteArray::fromRawData((const char *)m_map + entry.first, entry.second);
+}
+
+AssetReply::AssetReply(QObject *parent, const QNetworkRequest &request, AssetBundle *bundle) :
+    QNetworkReply(parent)
+{
+    m_pos = 0;
+    setRequest(request);
+    setUrl(request.url());
+    setOperation(QNetworkAccessManager::GetOperation);
+    open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+
+    QString name = request.url().path();
+    if (name.startsWith("/")) name = name.mid(1);
+
+    if (bundle && bundle->contains(name)) {
+        m_data = bundle->data(name);
+        static QMimeDatabase mimedb;
+        setHeader(QNetworkRequest::ContentTypeHeader, mimedb.mimeTypeForFile(name, QMimeDatabase::MatchExtension).name());
+        setHeader(QNetworkRequest::ContentLengthHeader, m_data.length());
+        setAttribute(QNetworkRequest::HttpStatusCodeAttribute, 200);
+    } else {
+        PLOG(lcFs, 1) << "[AssetReply::AssetReply] not in bundle" << name;
+        setError(QNetworkReply::ContentNotFoundError, "Not found in asset bundle: " + name);
+        setAttribute(QNetworkRequest::HttpStatusCodeAttribute, 404);
+    }
+    setFinished(true);
+    QTimer::singleShot(0, this, SLOT(emitSignals()));
+}
+
+void AssetReply::emitSignals() {
+    if (error() != QNetworkReply::NoError) {
+        emit error(error());
+    } else {
+        emit metaDataChanged();
+        emit downloadProgress(m_data.length(), m_data.length());
+        emit readyRead();
+    }
+    emit finished();
+}
+
+void AssetReply::abort() {
+    close();
+}
+
+qint64 AssetReply::bytesAvailable() const {
+    return m_data.length() - m_pos + QNetworkReply::bytesAvailable();
+}
+
+bool AssetReply::isSequential() const {
+    return true;
+}
+
+qint64 AssetReply::readData(char *data, qint64 maxlen) {
+    if (m_pos >= m_data.length()) return -1;
+    qint64 n = qMin(maxlen, m_data.length() - m_pos);
+    memcpy(data, m_data.constData() + m_pos, n);
+    m_pos += n;
+    return n;
+}
+
+AssetNetworkManager::AssetNetworkManager(QObject *parent) :
+    QNetworkAccessManager(parent)
+{
+    m_bundle = NULL;
+}
+
+AssetNetworkManager::~AssetNetworkManager() {
+    setBundle(NULL);
+}
+
+void AssetNetworkManager::setBundle(AssetBundle *bundle) {
+    if (m_bundle) {
+        qDeleteAll(findChildren<AssetReply *>());
+        delete m_bundle;
+    }
+    m_bundle = bundle;
+}
+
+AssetBundle *AssetNetworkManager::bundle() {
+    return m_bundle;
+}
+
+QNetworkReply *AssetNetworkManager::createRequest(Operation op, const QNetworkRequest &request, QIODevice *outgoingData) {
+    if (request.url().scheme() == "popcorn" && request.url().host() == "assets" && op == GetOperation) {
+        return new AssetReply(this, request, m_bundle);
+    }
+    return QNetworkAccessManager::createRequest(op, request, outgoingData);
+}
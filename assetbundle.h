@@ -0,0 +1,115 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef ASSETBUNDLE_H
+#define ASSETBUNDLE_H
+
+#include <QFile>
+#include <QHash>
+#include <QPair>
+#include <QString>
+#include <QByteArray>
+#include <QNetworkReply>
+#include <QNetworkAccessManager>
+
+/* The UI assets packed into one indexed file, so that they can be served
+ * from memory instead of being copied into the working directory and
+ * opened one by one. Layout, integers big-endian:
+ *
+ *   "PCAB", u32 format version, u16 length + assets version (UTF-8),
+ *   u32 entry count, entries of u16 length + name (UTF-8, relative,
+ *   '/' separated), u64 offset, u64 size; then the file contents.
+ *
+ * The assets version is taken from js/version.js when packing, like
+ * boot.js does for asset directories.
+ */
+class AssetBundle
+{
+public:
+    AssetBundle();
+    ~AssetBundle();
+
+    static bool pack(QString src_dir_abs, QString bundle_abs, QString *error);
+    static QString readVersion(QString bundle_abs);
+    static QString versionFromDir(QString src_dir_abs);
+    static int compareVersions(QString a, QString b);
+
+    bool open(QString bundle_abs);
+    QString version();
+    QString path();
+    bool contains(QString name);
+    QByteArray data(QString name);
+
+private:
+    QFile m_file;
+    uchar *m_map;
+    qint64 m_size;
+    QString m_version;
+    QHash<QString, QPair<qint64, qint64> > m_index;
+};
+
+/* Serves a bundle entry without copying it out of the mapped file.
+ */
+class AssetReply : public QNetworkReply
+{
+    Q_OBJECT
+public:
+    explicit AssetReply(QObject *parent, const QNetworkRequest &request, AssetBundle *bundle);
+
+    void abort();
+    qint64 bytesAvailable() const;
+    bool isSequential() const;
+
+protected:
+    qint64 readData(char *data, qint64 maxlen);
+
+private:
+    QByteArray m_data;
+    qint64 m_pos;
+
+private slots:
+    void emitSignals();
+};
+
+/* Answers GET requests for popcorn://assets/<name> from the bundle and
+ * passes everything else on to QNetworkAccessManager. The manager owns
+ * the bundle; replies still pointing into it are deleted before it is
+ * unmapped.
+ */
+class AssetNetworkManager : public QNetworkAccessManager
+{
+    Q_OBJECT
+public:
+    explicit AssetNetworkManager(QObject *parent = 0);
+    ~AssetNetworkManager();
+
+    void setBundle(AssetBundle *bundle);
+    AssetBundle *bundle();
+
+protected:
+    QNetworkReply *createRequest(Operation op, const QNetworkRequest &request, QIODevice *outgoingData = 0);
+
+private:
+    AssetBundle *m_bundle;
+};
+
+#endif // ASSETBUNDLE_H
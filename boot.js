@@ -28,10 +28,14 @@
  * 
  */
 
+API.traceMark("boot.js");
+
 var msg = document.getElementById("msg");
 var static_paths = API.getStaticPaths();
 var fileread_jailed = API.getConfiguration("fileread_jailed") == "true";
 var log_lines = [];
+var pending_copies = 0;
+var pending_url = null;
 var paths = {
   home: static_paths.home_path,
   application: static_paths.application_path,
@@ -42,6 +46,24 @@ var paths = {
 
 function navigateTo(path) {
   var url = "file:///" + path + "assets/index.html";
+  navigateToUrl(url);
+}
+
+/**
+ * Navigates once all copies started by copyDirFromAppDirToWorkingDir
+ * have finished.
+ */
+function navigateToUrl(url) {
+  pending_url = url;
+  navigateWhenCopied();
+}
+
+function navigateWhenCopied() {
+  if (pending_copies > 0 || !pending_url) {
+    return;
+  }
+  var url = pending_url;
+  pending_url = null;
   mylog("Navigating to", url);
   setTimeout(function() {
     location.href = url;
@@ -79,20 +101,31 @@ function mylog() {
 
 function copyDirFromAppDirToWorkingDir(relpath) {
   var result;
-  
-  mylog("Removing", paths.working + relpath);
-  result = API.dirRemove("working", relpath);
-  mylog("Remove result:", result);
 
   mylog("Making dir", paths.working + relpath);
   result = API.dirMake("working", relpath);
   mylog("Making dir result:", result);
   
+  // mirror mode removes obsolete files and skips unchanged ones,
+  // so there is no need to remove the directory first
   var srcpath = relJailPathMaybeToAbsPath("application", relpath)
   var destpath_rel = relpath;
-  mylog("Copying from", destpath_rel, "to", srcpath);
-  result = API.dirCopy(destpath_rel, "working", srcpath, "application");
-  mylog("Copying", result);
+  mylog("Copying from", srcpath, "to", destpath_rel);
+  
+  // in the background, so that the boot page stays responsive
+  var copier = API.createDirCopier(destpath_rel, "working", srcpath, "application", true);
+  if (!copier) {
+    mylog("Copying not possible:", relpath);
+    return;
+  }
+  pending_copies++;
+  copier.finished.connect(function(info) {
+    mylog("Copying", relpath, info.status, info.copied, "copied", info.skipped, "skipped");
+    copier.deleteLater();
+    pending_copies--;
+    navigateWhenCopied();
+  });
+  copier.run();
 }
 
 
@@ -152,6 +185,28 @@ function setupAssets() {
   return url;
 }
 
+/**
+ * The bundle chosen by the application is used unless the working
+ * directory holds newer unpacked assets, e.g. from an older upgrade.
+ */
+function setupAssetBundle() {
+  var bundle_version = API.getAssetBundleVersion();
+  if (!bundle_version) {
+    return null;
+  }
+  mylog("Found asset bundle: Version", bundle_version);
+  
+  if (API.fileExists("working", "assets/js/version.js")) {
+    var str = API.fileRead("working", "assets/js/version.js");
+    var matches = str.match(/assets_version = ['"](.+)["']/);
+    if (matches && versionStrToNumber(matches[1]) > versionStrToNumber(bundle_version)) {
+      mylog("Newer assets found in working directory: Version", matches[1]);
+      return null;
+    }
+  }
+  return "popcorn://assets/index.html";
+}
+
 /**
  * Copy newer versions of plugins from app dir to working dir.
  */
@@ -194,8 +249,15 @@ function setupPlugins() {
 
 mylog(API.getAppName(), API.getVersion());
 mylog("Booting...");
-var boot_from = setupAssets();
-if (boot_from) {
+var boot_url = setupAssetBundle();
+var boot_from = boot_url ? null : setupAssets();
+API.traceMark("boot.js assets");
+if (boot_url) {
+  setupPlugins();
+  API.traceMark("boot.js plugins");
+  navigateToUrl(boot_url);
+} else if (boot_from) {
   setupPlugins();
+  API.traceMark("boot.js plugins");
   navigateTo(boot_from);
 }
\ No newline at end of file
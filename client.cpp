@@ -21,6 +21,10 @@
  */
 
 #include "client.h"
+#include "logging.h"
+#include "settingsbuffer.h"
+#include "contentstore.h"
+#include "codec.h"
 #include <QDir>
 #include <QUrl>
 #include <QSslCipher>
@@ -31,7 +35,7 @@
 Client::Client(QObject *parent, QString id, QString location) :
     QObject(parent)
 {
-    qDebug() << "Level1 [Client::initialize]:" << id << location;
+    PLOG(lcNet, 1) << "[Client::initialize]:" << id << location;
     m_id = id;
     m_socket = NULL;
 
@@ -42,46 +46,49 @@ Client::Client(QObject *parent, QString id, QString location) :
 
     m_binaryMode = false;
     m_fileMode = false;
+    m_dirMode = false;
+    m_dirWriter = NULL;
+    m_dirReader = NULL;
     m_location = location;
 }
 
 Client::~Client() {
-     qDebug() << "Level1 [Client::~Client]:" << m_id;
+     PLOG(lcNet, 1) << "[Client::~Client]:" << m_id;
 }
 
 int Client::connectToServer(QString host, qint64 port) {
-    qDebug() << "Level0 [Client::connectToServer] Connecting to" << host << port;
+    PLOG(lcNet, 0) << "[Client::connectToServer] Connecting to" << host << port;
     m_socket->connectToHost(host, port);
     return m_socket->socketDescriptor();
 }
 
 
 void Client::startClientEncryption() {
-    qDebug() << "Level1 [Client::startClientEncryption]" << m_id;
+    PLOG(lcNet, 1) << "[Client::startClientEncryption]" << m_id;
     m_socket->startClientEncryption();
 }
 
 
 void Client::startServerEncryption() {
-    qDebug() << "Level1 [Client::startServerEncryption]" << m_id;
+    PLOG(lcNet, 1) << "[Client::startServerEncryption]" << m_id;
     m_socket->startServerEncryption();
 }
 
 
 QString Client::getPeerAddress() {
     QString peerAddress = m_socket->peerAddress().toString();
-    qDebug() << "Level1 [Client::getPeerAddress]" << m_id << peerAddress;
+    PLOG(lcNet, 1) << "[Client::getPeerAddress]" << m_id << peerAddress;
     return peerAddress;
 }
 
 int Client::getState() {
-    qDebug() << "Level1 [Client::getState]" << m_id;
+    PLOG(lcNet, 1) << "[Client::getState]" << m_id;
     return (int)m_socket->state();
 }
 
 
 QString Client::createSocket(bool is_server, int sd) {
-    qDebug() << "Level1 [Client::createSocket] begin" << m_id << is_server << sd;
+    PLOG(lcNet, 1) << "[Client::createSocket] begin" << m_id << is_server << sd;
 
     m_socket = new QSslSocket(this);
 
@@ -112,18 +119,19 @@ QString Client::createSocket(bool is_server, int sd) {
         QString application_path = QFileInfo(application_filepath).canonicalPath();
 
         bool result = m_socket->addCaCertificates(application_path + "/certs/*.pem", QSsl::Pem, QRegExp::WildcardUnix);
-        qDebug() << "Level1 [Client::createSocket] RESULT OF CERTS" << application_path + "/certs/*.pem" << result;
+        PLOG(lcNet, 1) << "[Client::createSocket] RESULT OF CERTS" << application_path + "/certs/*.pem" << result;
     }
 
-    qDebug() << "Level1 [Client::createSocket] end" << m_id << is_server << m_socket->peerAddress();
+    PLOG(lcNet, 1) << "[Client::createSocket] end" << m_id << is_server << m_socket->peerAddress();
     return m_socket->peerAddress().toString();
 }
 
 
 
 void Client::stop() {
-    qDebug() << "Level0 [Client::stop]" << m_id;
+    PLOG(lcNet, 0) << "[Client::stop]" << m_id;
     unsetFileMode();
+    unsetDirMode();
     m_buffer.resize(0);
     m_socket->close();
     m_socket->deleteLater();
@@ -132,33 +140,55 @@ void Client::stop() {
 
 qint64 Client::writePlain(QString cmd) {
     qint64 written_bytes = m_socket->write(cmd.toUtf8());
-    qDebug() << "Level4 [Client::writePlain] " << m_socket->socketDescriptor() << "======>" << cmd.trimmed();
+    PLOG(lcNet, 4) << "[Client::writePlain] " << m_socket->socketDescriptor() << "======>" << cmd.trimmed();
     return written_bytes;
 }
 
 
 void Client::doFlush() {
-    qDebug() << "Level2 [Client::doFlush]";
+    PLOG(lcNet, 2) << "[Client::doFlush]";
     m_socket->flush();
 }
 
 
 QString Client::getMessage() {
-    qDebug() << "Level1 [Client::getMessage]";
+    PLOG(lcNet, 1) << "[Client::getMessage]";
     return QString::fromLatin1(m_buffer.toHex());
 }
 
 
 int Client::setMessage(QString hex) {
-    qDebug() << "Level1 [Client::setMessage]";
+    PLOG(lcNet, 1) << "[Client::setMessage]";
     m_buffer.resize(0);
     m_buffer.append(QByteArray::fromHex(hex.toLatin1()));
     return m_buffer.length();
 }
 
 
-QVariantMap Client::setFileMode(QString type, QString filepath, qint64 pos) {
-    qDebug() << "Level1 [Client::setFileMode]" << m_socket->socketDescriptor() << type << filepath << pos;
+/* Like setMessage(mapToHex(map)) and hexToMap(getMessage()), without
+ * the hex round trip through JavaScript strings.
+ */
+int Client::setMessageMap(QVariantMap map, QString format) {
+    PLOG(lcNet, 1) << "[Client::setMessageMap]";
+    if (format == "") format = settings_buffer->value("wire_format").toString();
+    Codec::encode(map, Codec::formatFromString(format), m_buffer);
+    return m_buffer.length();
+}
+
+
+QVariantMap Client::getMessageMap() {
+    PLOG(lcNet, 1) << "[Client::getMessageMap]";
+    return Codec::decode(m_buffer);
+}
+
+
+/* When receiving with a known content hash that is already in the
+ * ContentStore, the file is linked from the store and "info" is
+ * "alreadyHave" instead of entering file mode, so the receiver can tell
+ * the sender to skip the transfer.
+ */
+QVariantMap Client::setFileMode(QString type, QString filepath, qint64 pos, QString hash) {
+    PLOG(lcNet, 1) << "[Client::setFileMode]" << m_socket->socketDescriptor() << type << filepath << pos << hash;
     QVariantMap info;
 
     if (m_fileMode == true) {
@@ -167,6 +197,12 @@ QVariantMap Client::setFileMode(QString type, QString filepath, qint64 pos) {
         return info;
     }
 
+    if (m_dirMode == true) {
+        info.insert("status", "Error");
+        info.insert("info", "alreadyInDirMode");
+        return info;
+    }
+
     m_fileMode = true;
     m_fileModeType = type; // direction
 
@@ -178,16 +214,26 @@ QVariantMap Client::setFileMode(QString type, QString filepath, qint64 pos) {
     }
 
     filepath = QDir().cleanPath(filepath);
-    qDebug() << "Level1 [Client::setFileMode] clean path" << filepath;
+    PLOG(lcNet, 1) << "[Client::setFileMode] clean path" << filepath;
 
     if (m_fileModeType == "send") {
         // make sure it is really in the jail
-        if (settings->value("fileread_jailed").toString() == "true") {
+        if (settings_buffer->value("fileread_jailed").toString() == "true") {
             filepath.prepend(jail_working_path);
         }
     } else {
         // receiving: we can put it anywhere in the working dir
         filepath.prepend(jail_working_path);
+
+        if (hash != "" && ContentStore::linkTo(hash, filepath)) {
+            m_fileMode = false;
+            m_fileModeType = "";
+            info.insert("status", "OK");
+            info.insert("info", "alreadyHave");
+            info.insert("size", QFileInfo(filepath).size());
+            PLOG(lcNet, 1) << "[Client::setFileMode] done" << info;
+            return info;
+        }
     }
 
     m_file = new QFile(filepath);
@@ -195,7 +241,7 @@ QVariantMap Client::setFileMode(QString type, QString filepath, qint64 pos) {
     if (m_fileModeType == "send" && !m_file->exists()) {
         info.insert("status", "Error");
         info.insert("info", "FileNotExistOrNotInJail");
-        qDebug() << "Level1 [Client::setFileMode] done" << info;
+        PLOG(lcNet, 1) << "[Client::setFileMode] done" << info;
         return info;
     }
 
@@ -209,7 +255,7 @@ QVariantMap Client::setFileMode(QString type, QString filepath, qint64 pos) {
     if (!m_file->open(open_mode)) {
         info.insert("status", "Error");
         info.insert("info", "cannotOpen");
-        qDebug() << "Level1 [Client::setFileMode] done" << info;
+        PLOG(lcNet, 1) << "[Client::setFileMode] done" << info;
         return info;
     }
 
@@ -217,13 +263,13 @@ QVariantMap Client::setFileMode(QString type, QString filepath, qint64 pos) {
     info.insert("status", "OK");
     info.insert("size", m_file->size());
     info.insert("pos", m_file->pos());
-    qDebug() << "Level1 [Client::setFileMode] done" << info;
+    PLOG(lcNet, 1) << "[Client::setFileMode] done" << info;
     return info;
 }
 
 
 void Client::unsetFileMode() {
-    qDebug() << "Level2 [Client::unsetFileMode]" << m_id << "closing file, mode is" << m_fileModeType;
+    PLOG(lcNet, 2) << "[Client::unsetFileMode]" << m_id << "closing file, mode is" << m_fileModeType;
     if (m_fileMode == false)
         return;
 
@@ -234,22 +280,120 @@ void Client::unsetFileMode() {
 }
 
 
-qint64 Client::writeBinary(qint64 chunksize) {
-    qDebug() << "Level1 [Client::writeBinary]" << m_id << "chunksize=" << chunksize;
+/* Sends a whole directory as one DirStream, without staging an archive.
+ * When sending, writeBinary() walks the directory and writes the next
+ * chunk of the stream; when receiving, the tree is recreated below
+ * dirpath in the working jail as the data arrives. Both ends emit
+ * dirModeFinished() when the stream is complete or has failed.
+ */
+QVariantMap Client::setDirMode(QString type, QString dirpath) {
+    PLOG(lcNet, 1) << "[Client::setDirMode]" << m_socket->socketDescriptor() << type << dirpath;
+    QVariantMap info;
+
     if (m_fileMode) {
+        info.insert("status", "Error");
+        info.insert("info", "alreadyInFileMode");
+        return info;
+    }
+
+    if (m_dirMode) {
+        info.insert("status", "Error");
+        info.insert("info", "alreadyInDirMode");
+        return info;
+    }
+
+    if (dirpath.contains("..")) {
+        info.insert("status", "Error");
+        info.insert("info", "FileContainsDotDot");
+        return info;
+    }
+
+    dirpath = QDir().cleanPath(dirpath);
+
+    if (type == "send") {
+        if (settings_buffer->value("fileread_jailed").toString() == "true") {
+            dirpath.prepend(jail_working_path);
+        }
+        m_dirWriter = new DirStreamWriter(dirpath);
+        if (!m_dirWriter->open()) {
+            delete m_dirWriter;
+            m_dirWriter = NULL;
+            info.insert("status", "Error");
+            info.insert("info", "DirNotExistOrNotInJail");
+            return info;
+        }
+    } else {
+        dirpath.prepend(jail_working_path);
+        if (!QDir().mkpath(dirpath)) {
+            info.insert("status", "Error");
+            info.insert("info", "cannotCreateDir");
+            return info;
+        }
+        m_dirReader = new DirStreamReader(dirpath);
+    }
+
+    m_dirMode = true;
+    m_dirModeType = type;
+    info.insert("status", "OK");
+    PLOG(lcNet, 1) << "[Client::setDirMode] done" << info;
+    return info;
+}
+
+
+void Client::unsetDirMode() {
+    PLOG(lcNet, 2) << "[Client::unsetDirMode]" << m_id << "mode is" << m_dirModeType;
+    delete m_dirWriter;
+    m_dirWriter = NULL;
+    delete m_dirReader;
+    m_dirReader = NULL;
+    m_dirModeType = "";
+    m_dirMode = false;
+}
+
+
+void Client::finishDirMode() {
+    QVariantMap info;
+    if (m_dirWriter) {
+        info.insert("status", "OK");
+        info.insert("files", m_dirWriter->files());
+        info.insert("bytes", m_dirWriter->bytes());
+    } else {
+        if (m_dirReader->error() == "") {
+            info.insert("status", "OK");
+        } else {
+            info.insert("status", "Error");
+            info.insert("info", m_dirReader->error());
+        }
+        info.insert("files", m_dirReader->files());
+        info.insert("bytes", m_dirReader->bytes());
+    }
+    PLOG(lcNet, 1) << "[Client::finishDirMode]" << m_id << info;
+    unsetDirMode();
+    emit dirModeFinished(info);
+}
+
+
+qint64 Client::writeBinary(qint64 chunksize) {
+    PLOG(lcNet, 1) << "[Client::writeBinary]" << m_id << "chunksize=" << chunksize;
+    if (m_dirMode && m_dirWriter) {
+        m_writtenCounter += m_socket->write(m_dirWriter->read(chunksize));
+        PLOG(lcNet, 1) << "[Client::writeBinary] dirMode. Wrote total" << m_writtenCounter;
+        if (m_dirWriter->atEnd()) finishDirMode();
+
+    } else if (m_fileMode) {
         m_writtenCounter += m_socket->write(m_file->read(chunksize));
-        qDebug() << "Level1 [Client::writeBinary] fileMode. Wrote total" << m_writtenCounter << "now at file POS" << m_file->pos();
+        PLOG(lcNet, 1) << "[Client::writeBinary] fileMode. Wrote total" << m_writtenCounter << "now at file POS" << m_file->pos();
 
     } else {
         m_writtenCounter += m_socket->write(m_buffer);
-        qDebug() << "Level1 [Client::writeBinary] messageMode. Wrote" << m_buffer.length() << "total" << m_writtenCounter;
+        PLOG(lcNet, 1) << "[Client::writeBinary] messageMode. Wrote" << m_buffer.length() << "total" << m_writtenCounter;
     }
     return m_writtenCounter;
 }
 
 
 void Client::onBytesWritten(qint64 size) {
-    qDebug() << "Level1 [Client::onBytesWritten]" << m_id << "nbytes_now=" << size;
+    PLOG(lcNet, 1) << "[Client::onBytesWritten]" << m_id << "nbytes_now=" << size;
     emit bytesWritten(size);
 }
 
@@ -264,21 +408,28 @@ void Client::onReadyRead() {
         QString str = QString::fromUtf8(ba.trimmed());
         QStringList cmds = str.split("\n");
         for (int k = 0; k < cmds.length(); k++) {
-            qDebug() << "Level1 [Client::onReadyRead]" << m_id << "<=====" << cmds.at(k);
+            PLOG(lcNet, 1) << "[Client::onReadyRead]" << m_id << "<=====" << cmds.at(k);
             emit readPlain(cmds.at(k));
         }
 
     } else {
         // BINARY MODE
-        if (m_fileMode) {
+        if (m_dirMode && m_dirReader) {
+            QByteArray rest;
+            if (!m_dirReader->write(ba, &rest) || m_dirReader->atEnd()) {
+                finishDirMode();
+            }
+            // data the peer sent after the end of the stream
+            if (!rest.isEmpty()) m_buffer.append(rest);
+        } else if (m_fileMode || m_dirMode) {
             if (m_fileModeType == "receive") {
-                qDebug() << "Level1 [Client::onReadyRead]" << m_id << "WRITING" << ba.size() << "TO FILE" << m_file->size() << "at POS" << m_file->pos();
+                PLOG(lcNet, 1) << "[Client::onReadyRead]" << m_id << "WRITING" << ba.size() << "TO FILE" << m_file->size() << "at POS" << m_file->pos();
                 m_file->write(ba);
             } else {
                 QString str = QString::fromUtf8(ba.trimmed());
                 QStringList cmds = str.split("\n");
                 for (int k = 0; k < cmds.length(); k++) {
-                    qDebug() << "Level1 [Client::onReadyRead]" << m_id << "FILE TRANSFER FEEDBACK         <=====" << cmds.at(k);
+                    PLOG(lcNet, 1) << "[Client::onReadyRead]" << m_id << "FILE TRANSFER FEEDBACK         <=====" << cmds.at(k);
                     emit readBinaryFeedback(cmds.at(k));
                 }
             }
@@ -286,14 +437,14 @@ void Client::onReadyRead() {
             m_buffer.append(ba);
         }
 
-        qDebug() << "Level4 [Client::onReadyRead]" << m_id << "         <====== now" << ba.length() << "total" << m_readCounter;
+        PLOG(lcNet, 4) << "[Client::onReadyRead]" << m_id << "         <====== now" << ba.length() << "total" << m_readCounter;
         emit readBinary(m_readCounter);
     }
 }
 
 
 void Client::setBinary(qint64 size) {
-    qDebug() << "Level2 [Client::setBinary]" << m_id;
+    PLOG(lcNet, 2) << "[Client::setBinary]" << m_id;
     m_dataSize = size;
     m_writtenCounter = 0;
     m_readCounter = 0;
@@ -302,7 +453,7 @@ void Client::setBinary(qint64 size) {
 
 
 void Client::unsetBinary() {
-    qDebug() << "Level2 [Client::unsetBinary]" << m_id;
+    PLOG(lcNet, 2) << "[Client::unsetBinary]" << m_id;
     QByteArray tmp = m_socket->readAll(); // empty buffer
     m_buffer.resize(0);
     m_dataSize = 0;
@@ -313,13 +464,13 @@ void Client::unsetBinary() {
 
 
 void Client::onSocketStateChange(QAbstractSocket::SocketState state) {
-    qDebug() << "Level2 [Client::onSocketStateChange]" << m_id << state << m_socket->peerAddress();
+    PLOG(lcNet, 2) << "[Client::onSocketStateChange]" << m_id << state << m_socket->peerAddress();
     emit socketStateChange((int)state);
 }
 
 
 void Client::resume() {
-    qDebug() << "Level1 [Client::resume]" << m_id;
+    PLOG(lcNet, 1) << "[Client::resume]" << m_id;
     m_socket->resume();
 
 }
@@ -330,13 +481,13 @@ void Client::onEncryptedBytesWritten(qint64 size) {
 
 
 void Client::onModeChanged(QSslSocket::SslMode mode) {
-    qDebug() << "Level1 [Client::onModeChanged]" << m_id << mode;
+    PLOG(lcNet, 1) << "[Client::onModeChanged]" << m_id << mode;
     emit modeChanged((int)mode);
 }
 
 
 void Client::onSocketSslErrors(QList<QSslError> errors) {
-    qDebug() << "Level1 [Client::onSocketSslErrors]" << m_id << errors;
+    PLOG(lcNet, 1) << "[Client::onSocketSslErrors]" << m_id << errors;
     QVariantMap map;
     for (int i = 0; i < errors.length(); i++) {
         map.insert(QString::number(i), errors.at(i).errorString());
@@ -345,12 +496,12 @@ void Client::onSocketSslErrors(QList<QSslError> errors) {
 }
 
 void Client::onSocketEncrypted() {
-    qDebug() << "Level1 [Client::onSocketEncrypted]" << m_id;
+    PLOG(lcNet, 1) << "[Client::onSocketEncrypted]" << m_id;
     emit socketEncrypted();
 }
 
 void Client::doIgnoreSslErrors() {
-    qDebug() << "Level1 [Client::doIgnoreSslErrors]" << m_id;
+    PLOG(lcNet, 1) << "[Client::doIgnoreSslErrors]" << m_id;
     m_socket->ignoreSslErrors();
 }
 
@@ -34,6 +34,8 @@
 #include <QFileInfo>
 #include <QSettings>
 
+#include "dirstream.h"
+
 
 extern QString jail_working_path;
 extern QSettings *settings;
@@ -70,6 +72,15 @@ private:
     QString m_fileModeType;
     QFile *m_file;
 
+    // directory stream stuff
+    bool m_dirMode;
+    QString m_dirModeType;
+    DirStreamWriter *m_dirWriter;
+    DirStreamReader *m_dirReader;
+
+    // methods
+    void finishDirMode();
+
 signals:
     void bytesWritten(qint64 size);
     void readPlain(QString cmd);
@@ -80,6 +91,7 @@ signals:
     void modeChanged(int mode);
     void socketErrors(QVariantMap map);
     void socketEncrypted();
+    void dirModeFinished(QVariantMap info);
 
 private slots:
     void onReadyRead();
@@ -95,13 +107,17 @@ public slots:
     void stop();
     int setMessage(QString hex);
     QString getMessage();
+    int setMessageMap(QVariantMap map, QString format = "");
+    QVariantMap getMessageMap();
     qint64 writePlain(QString cmd);
     qint64 writeBinary(qint64 chunksize);
     void setBinary(qint64 size);
     void unsetBinary();
     void doFlush();
-    QVariantMap setFileMode(QString type, QString fileName, qint64 pos = 0);
+    QVariantMap setFileMode(QString type, QString fileName, qint64 pos = 0, QString hash = "");
     void unsetFileMode();
+    QVariantMap setDirMode(QString type, QString dirpath);
+    void unsetDirMode();
     QString createSocket(bool is_server = false, int sd = 0);
     QString getPeerAddress();
     QVariantMap getInfo();
@@ -0,0 +1,348 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "codec.h"
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QStringList>
+#include <QtEndian>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <limits.h>
+
+#define CODEC_MAX_DEPTH 64
+
+enum {
+    CborUnsigned = 0,
+    CborNegative = 1,
+    CborBytes = 2,
+    CborText = 3,
+    CborArray = 4,
+    CborMap = 5,
+    CborTag = 6,
+    CborSimple = 7
+};
+
+static const char cbor_magic[3] = { (char)0xd9, (char)0xd9, (char)0xf7 };
+
+Codec::Format Codec::formatFromString(QString name) {
+    return name == "cbor" ? CborFormat : QDataStreamFormat;
+}
+
+bool Codec::isCbor(const QByteArray &ba) {
+    return ba.length() >= 3 && memcmp(ba.constData(), cbor_magic, 3) == 0;
+}
+
+void Codec::encode(const QVariantMap &map, Format format, QByteArray &out) {
+    out.resize(0);
+    if (format == QDataStreamFormat) {
+        QDataStream stream(&out, QIODevice::WriteOnly);
+        stream << map;
+        return;
+    }
+    out.append(cbor_magic, 3);
+    writeValue(out, map);
+}
+
+/* Returns an empty map if ba is not a valid message.
+ */
+QVariantMap Codec::decode(const QByteArray &ba) {
+    if (!isCbor(ba)) {
+        QDataStream stream(ba);
+        QVariantMap map;
+        stream >> map;
+        return map;
+    }
+    int pos = 3;
+    bool ok = true;
+    QVariant value = readValue(ba, pos, 0, ok);
+    if (!ok || value.type() != QVariant::Map) return QVariantMap();
+    return value.toMap();
+}
+
+void Codec::writeHead(QByteArray &out, int major, quint64 value) {
+    uchar buf[9];
+    int length;
+    if (value < 24) {
+        buf[0] = (major << 5) | value;
+        length = 1;
+    } else if (value <= 0xFF) {
+        buf[0] = (major << 5) | 24;
+        buf[1] = value;
+        length = 2;
+    } else if (value <= 0xFFFF) {
+        buf[0] = (major << 5) | 25;
+        qToBigEndian<quint16>(value, buf + 1);
+        length = 3;
+    } else if (value <= 0xFFFFFFFFULL) {
+        buf[0] = (major << 5) | 26;
+        qToBigEndian<quint32>(value, buf + 1);
+        length = 5;
+    } else {
+        buf[0] = (major << 5) | 27;
+        qToBigEndian<quint64>(value, buf + 1);
+        length = 9;
+    }
+    out.append((const char *)buf, length);
+}
+
+void Codec::writeValue(QByteArray &out, const QVariant &value) {
+    switch ((int)value.type()) {
+    case QVariant::Invalid:
+        out.append((char)0xf6); // null
+        break;
+    case QVariant::Bool:
+        out.append((char)(value.toBool() ? 0xf5 : 0xf4));
+        break;
+    case QVariant::Int:
+    case QVariant::LongLong: {
+        qint64 v = value.toLongLong();
+        if (v >= 0) {
+            writeHead(out, CborUnsigned, v);
+        } else {
+            writeHead(out, CborNegative, (quint64)(-1 - v));
+        }
+        break;
+    }
+    case QVariant::UInt:
+    case QVariant::ULongLong:
+        writeHead(out, CborUnsigned, value.toULongLong());
+        break;
+    case QMetaType::Float:
+    case QVariant::Double: {
+        double d = value.toDouble();
+        // Javascript numbers are all doubles; ports, sizes and ids are
+        // integral and take 1-9 bytes as CBOR integers instead of 5 or 9
+        if (fabs(d) <= 9007199254740992.0 && d == floor(d) && !(d == 0 && signbit(d))) {
+            qint64 v = (qint64)d;
+            if (v >= 0) {
+                writeHead(out, CborUnsigned, v);
+            } else {
+                writeHead(out, CborNegative, (quint64)(-1 - v));
+            }
+            break;
+        }
+        uchar buf[9];
+        float f = (fabs(d) <= FLT_MAX) ? (float)d : 0;
+        if ((double)f == d || d != d) {
+            // single precision is exact (or NaN)
+            quint32 bits;
+            memcpy(&bits, &f, 4);
+            buf[0] = 0xfa;
+            qToBigEndian<quint32>(bits, buf + 1);
+            out.append((const char *)buf, 5);
+        } else {
+            quint64 bits;
+            memcpy(&bits, &d, 8);
+            buf[0] = 0xfb;
+            qToBigEndian<quint64>(bits, buf + 1);
+            out.append((const char *)buf, 9);
+        }
+        break;
+    }
+    case QVariant::ByteArray: {
+        QByteArray ba = value.toByteArray();
+        writeHead(out, CborBytes, ba.length());
+        out.append(ba);
+        break;
+    }
+    case QVariant::DateTime: {
+        // tag 1: seconds since the epoch
+        writeHead(out, CborTag, 1);
+        writeValue(out, value.toDateTime().toMSecsSinceEpoch() / 1000.0);
+        break;
+    }
+    case QVariant::List:
+    case QVariant::StringList: {
+        QVariantList list = value.toList();
+        writeHead(out, CborArray, list.length());
+        foreach (const QVariant &item, list) writeValue(out, item);
+        break;
+    }
+    case QVariant::Map: {
+        QVariantMap map = value.toMap();
+        writeHead(out, CborMap, map.size());
+        for (QVariantMap::const_iterator it = map.constBegin(); it != map.constEnd(); ++it) {
+            QByteArray key = it.key().toUtf8();
+            writeHead(out, CborText, key.length());
+            out.append(key);
+            writeValue(out, it.value());
+        }
+        break;
+    }
+    case QVariant::Hash: {
+        QVariantHash hash = value.toHash();
+        writeHead(out, CborMap, hash.size());
+        for (QVariantHash::const_iterator it = hash.constBegin(); it != hash.constEnd(); ++it) {
+            QByteArray key = it.key().toUtf8();
+            writeHead(out, CborText, key.length());
+            out.append(key);
+            writeValue(out, it.value());
+        }
+        break;
+    }
+    default: {
+        // QString and anything else convertible to text
+        QByteArray text = value.toString().toUtf8();
+        writeHead(out, CborText, text.length());
+        out.append(text);
+        break;
+    }
+    }
+}
+
+bool Codec::readHead(const QByteArray &ba, int &pos, int &major, int &info, quint64 &value) {
+    if (pos >= ba.length()) return false;
+    const uchar *p = (const uchar *)ba.constData();
+    uchar initial = p[pos++];
+    major = initial >> 5;
+    info = initial & 0x1f;
+
+    if (info < 24) {
+        value = info;
+        return true;
+    }
+    int length;
+    if (info == 24) length = 1;
+    else if (info == 25) length = 2;
+    else if (info == 26) length = 4;
+    else if (info == 27) length = 8;
+    else if (info == 31) {
+        // indefinite length
+        value = 0;
+        return true;
+    } else return false;
+
+    if (pos + length > ba.length()) return false;
+    if (length == 1) value = p[pos];
+    else if (length == 2) value = qFromBigEndian<quint16>(p + pos);
+    else if (length == 4) value = qFromBigEndian<quint32>(p + pos);
+    else value = qFromBigEndian<quint64>(p + pos);
+    pos += length;
+    return true;
+}
+
+static double halfToDouble(quint16 half) {
+    int exponent = (half >> 10) & 0x1f;
+    int mantissa = half & 0x3ff;
+    double v;
+    if (exponent == 0) v = ldexp((double)mantissa, -24);
+    else if (exponent != 31) v = ldexp((double)(mantissa + 1024), exponent - 25);
+    else v = mantissa == 0 ? INFINITY : NAN;
+    return (half & 0x8000) ? -v : v;
+}
+
+QVariant Codec::readValue(const QByteArray &ba, int &pos, int depth, bool &ok) {
+    int major;
+    int info;
+    quint64 value;
+    if (depth > CODEC_MAX_DEPTH || !readHead(ba, pos, major, info, value)) {
+        ok = false;
+        return QVariant();
+    }
+    bool indefinite = (info == 31);
+    const uchar *p = (const uchar *)ba.constData();
+
+    switch (major) {
+    case CborUnsigned:
+        if (value <= (quint64)INT_MAX) return QVariant((int)value);
+        if (value <= (quint64)LLONG_MAX) return QVariant((qlonglong)value);
+        return QVariant((qulonglong)value);
+    case CborNegative:
+        if (value < (quint64)INT_MAX) return QVariant((int)(-1 - (qint64)value));
+        if (value < (quint64)LLONG_MAX) return QVariant((qlonglong)(-1 - (qint64)value));
+        return QVariant(-1.0 - (double)value);
+    case CborBytes:
+    case CborText: {
+        if (indefinite || value > (quint64)(ba.length() - pos)) break;
+        QByteArray data = ba.mid(pos, (int)value);
+        pos += (int)value;
+        if (major == CborBytes) return QVariant(data);
+        return QVariant(QString::fromUtf8(data));
+    }
+    case CborArray: {
+        QVariantList list;
+        for (quint64 i = 0; indefinite || i < value; i++) {
+            if (indefinite && pos < ba.length() && p[pos] == 0xff) {
+                pos++;
+                break;
+            }
+            // every item takes at least one byte
+            if (pos >= ba.length()) {
+                ok = false;
+                return QVariant();
+            }
+            list.append(readValue(ba, pos, depth + 1, ok));
+            if (!ok) return QVariant();
+        }
+        return QVariant(list);
+    }
+    case CborMap: {
+        QVariantMap map;
+        for (quint64 i = 0; indefinite || i < value; i++) {
+            if (indefinite && pos < ba.length() && p[pos] == 0xff) {
+                pos++;
+                break;
+            }
+            if (pos >= ba.length()) {
+                ok = false;
+                return QVariant();
+            }
+            QVariant key = readValue(ba, pos, depth + 1, ok);
+            if (!ok) return QVariant();
+            QVariant item = readValue(ba, pos, depth + 1, ok);
+            if (!ok) return QVariant();
+            map.insert(key.toString(), item);
+        }
+        return QVariant(map);
+    }
+    case CborTag: {
+        QVariant item = readValue(ba, pos, depth + 1, ok);
+        if (!ok) return QVariant();
+        if (value == 1 && (item.type() == QVariant::Double || item.type() == QVariant::Int || item.type() == QVariant::LongLong)) {
+            return QVariant(QDateTime::fromMSecsSinceEpoch(llround(item.toDouble() * 1000.0)));
+        }
+        return item; // unknown tags are ignored
+    }
+    case CborSimple:
+        if (info == 25) return QVariant(halfToDouble(value));
+        if (info == 26) {
+            quint32 bits = value;
+            float f;
+            memcpy(&f, &bits, 4);
+            return QVariant((double)f);
+        }
+        if (info == 27) {
+            double d;
+            memcpy(&d, &value, 8);
+            return QVariant(d);
+        }
+        if (value == 20) return QVariant(false);
+        if (value == 21) return QVariant(true);
+        if (value == 22 || value == 23) return QVariant();
+        break;
+    }
+    ok = false;
+    return QVariant();
+}
@@ -0,0 +1,61 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVariant>
+#include <QVariantMap>
+
+/* Serialization of protocol messages (QVariantMap).
+ *
+ * QDataStreamFormat is the original format. It depends on the Qt version
+ * and is verbose. CborFormat is compact CBOR (RFC 7049), written by hand
+ * so it does not depend on the Qt version either. A CBOR message starts
+ * with the self-describe tag 55799 (bytes d9 d9 f7), which also serves
+ * as the format marker: decode() recognizes it, so peers can decode both
+ * formats regardless of which one they send. A future incompatible
+ * version would use a different leading tag.
+ *
+ * encode() clears out and writes into it. Pass the same buffer again to
+ * reuse its allocation.
+ */
+class Codec
+{
+public:
+    enum Format { QDataStreamFormat, CborFormat };
+
+    static Format formatFromString(QString name);
+    static bool isCbor(const QByteArray &ba);
+    static void encode(const QVariantMap &map, Format format, QByteArray &out);
+    static QVariantMap decode(const QByteArray &ba);
+
+private:
+    static void writeHead(QByteArray &out, int major, quint64 value);
+    static void writeValue(QByteArray &out, const QVariant &value);
+    static bool readHead(const QByteArray &ba, int &pos, int &major, int &info, quint64 &value);
+    static QVariant readValue(const QByteArray &ba, int &pos, int depth, bool &ok);
+};
+
+#endif // CODEC_H
@@ -0,0 +1,107 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "contentstore.h"
+#include "logging.h"
+#include "fileutil.h"
+#include "hashjob.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QRegExp>
+#include <QThread>
+#include <QDebug>
+
+QString ContentStore::storePath() {
+    return data_path + "store/";
+}
+
+bool ContentStore::isValidHash(QString hash) {
+    return QRegExp("[0-9a-f]{16,128}").exactMatch(hash);
+}
+
+QString ContentStore::objectPath(QString hash) {
+    return storePath() + hash.left(2) + "/" + hash;
+}
+
+bool ContentStore::has(QString hash) {
+    if (!isValidHash(hash)) return false;
+    return QFile::exists(objectPath(hash));
+}
+
+/* Places the stored object at filepath_abs, replacing an existing file.
+ */
+bool ContentStore::linkTo(QString hash, QString filepath_abs) {
+    if (!has(hash)) return false;
+    QString object = objectPath(hash);
+
+    QDir().mkpath(QFileInfo(filepath_abs).absolutePath());
+    if (QFile::exists(filepath_abs) && !QFile::remove(filepath_abs)) return false;
+
+    bool success = FileUtil::copyFile(object, filepath_abs);
+    PLOG(lcFs, 1) << "[ContentStore::linkTo]" << hash << filepath_abs << success;
+    return success;
+}
+
+/* Adds a completely received file to the store under hash, after
+ * hashing it with hashtype (and tree, see HashJob) and refusing a
+ * mismatch. Blocks for the time of hashing and copying; call it from a
+ * worker thread. A file whose content is already stored is left as it is.
+ */
+bool ContentStore::import(QString filepath_abs, QString hash, int hashtype, bool tree, QString *error) {
+    if (!isValidHash(hash)) {
+        *error = "invalidHash";
+        return false;
+    }
+    if (!QFile::exists(filepath_abs)) {
+        *error = "fileNotExisting";
+        return false;
+    }
+    QString actual = HashJob::hashFile(filepath_abs, hashtype, tree);
+    if (actual == "") {
+        *error = "cannotHash";
+        return false;
+    }
+    if (actual != hash) {
+        PLOG(lcFs, 0) << "[ContentStore::import] hash mismatch" << filepath_abs << hash << actual;
+        *error = "hashMismatch";
+        return false;
+    }
+    if (has(hash)) return true;
+
+    // copied under a name unique to this thread, so that has() never sees
+    // a partial object and concurrent imports do not collide
+    QString object = objectPath(hash);
+    QString part = object + ".part" + QString::number((quintptr)QThread::currentThreadId());
+    QDir().mkpath(QFileInfo(object).absolutePath());
+    QFile::remove(part);
+    bool success = FileUtil::copyFile(filepath_abs, part) && QFile::rename(part, object);
+    if (!success) {
+        QFile::remove(part);
+        // another import of the same content may have won the rename
+        if (has(hash)) return true;
+        *error = "cannotCopy";
+    }
+    PLOG(lcFs, 1) << "[ContentStore::import]" << hash << filepath_abs << success;
+    return success;
+}
@@ -0,0 +1,54 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef CONTENTSTORE_H
+#define CONTENTSTORE_H
+
+#include <QString>
+
+extern QString data_path;
+
+/* A content-addressed store of received files, keyed by the hex digest of
+ * their content. It lives in data_path, outside all jails, so that
+ * Javascript cannot write to stored objects, and import() hashes the file
+ * itself, so that no object is stored under a wrong key.
+ *
+ * Objects are placed at the user's path as reflinks where the file system
+ * supports them, otherwise as full copies. Never as hard links: a user
+ * file written in place would then change the stored object under its old
+ * hash. Without reflinks the store therefore saves transfers, not disk
+ * space. The hash algorithm is chosen by the caller and must be used
+ * consistently.
+ */
+class ContentStore
+{
+public:
+    static QString storePath();
+    static bool isValidHash(QString hash);
+    static QString objectPath(QString hash);
+
+    static bool has(QString hash);
+    static bool linkTo(QString hash, QString filepath_abs);
+    static bool import(QString filepath_abs, QString hash, int hashtype, bool tree, QString *error);
+};
+
+#endif // CONTENTSTORE_H
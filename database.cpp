@@ -21,6 +21,10 @@
  */
 
 #include "database.h"
+#include "logging.h"
+#include "settingsbuffer.h"
+#include "database_worker.h"
+#include "querystats.h"
 
 #include <QSqlDatabase>
 #include <QSqlQuery>
@@ -30,32 +34,58 @@
 #include <QSqlError>
 #include <QDebug>
 #include <QSettings>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QRegExp>
 #include "math.h"
 
 Database::Database(QString label, QObject *parent) :
     QObject(parent)
 {
-    qDebug() << "Level0 [Database::Database] initialized";
+    PLOG(lcDb, 0) << "[Database::Database] initialized";
     m_is_setup = false;
+    m_in_transaction = false;
+    m_cursorID = 0;
+    m_worker = NULL;
+    m_readPoolSize = 0;
+    m_nextReader = 0;
+    m_requestID = 0;
+    m_profile = settings_buffer->value("db_profile").toString();
+    if (!profiles().contains(m_profile)) m_profile = "default";
+    m_stats = new QueryStats(settings_buffer->value("db_slow_query_ms", 100).toInt());
     m_label = label;
 }
 
 Database::~Database() {
-    qDebug() << "Level0 [Database::~Database] Called";
+    PLOG(lcDb, 0) << "[Database::~Database] Called";
     close();
-    qDebug() << "Level0 [Database::~Database] Done";
+    if (m_worker) destroyWorker(m_worker);
+    foreach (DatabaseWorker *reader, m_readers) {
+        destroyWorker(reader);
+    }
+    if (m_is_setup) {
+        m_query = QSqlQuery();
+        m_db = QSqlDatabase();
+        QSqlDatabase::removeDatabase(m_connection_name);
+    }
+    delete m_stats;
+    PLOG(lcDb, 0) << "[Database::~Database] Done";
 }
 
 void Database::setup(QString dbpath) {
     if (m_is_setup) {
-        qDebug() << "Level0 [Database::setup] already set up" << dbpath;
+        PLOG(lcDb, 0) << "[Database::setup] already set up" << dbpath;
         return;
     }
 
-    qDebug() << "Level0 [Database::setup] setting up" << dbpath;
-    m_db = QSqlDatabase::addDatabase("QSQLITE");
+    // every Database gets its own connection; an unnamed addDatabase()
+    // would replace the default connection of other Database objects
+    m_connection_name = QString("%1_%2").arg(m_label).arg((quintptr)this);
+    PLOG(lcDb, 0) << "[Database::setup] setting up" << dbpath << m_connection_name;
+    m_db = QSqlDatabase::addDatabase("QSQLITE", m_connection_name);
     m_db.setDatabaseName(dbpath);
     m_db.setHostName("localhost");
+    m_dbpath = dbpath;
 
     m_query = QSqlQuery(m_db);
     m_query.setForwardOnly(true);
@@ -65,6 +95,9 @@ void Database::setup(QString dbpath) {
 
 
 void Database::close() {
+    foreach (int cursor, m_cursors.keys()) {
+        closeCursor(cursor);
+    }
     m_db.close();
 }
 
@@ -74,8 +107,10 @@ QVariantMap Database::open() {
     if (!success) {
         errors.insert("db", m_db.lastError().databaseText());
         errors.insert("driver", m_db.lastError().driverText());
+    } else {
+        errors = applyProfile(m_db, m_profile);
     }
-    qDebug() << "Level0 [Database::open]" << errors;
+    PLOG(lcDb, 0) << "[Database::open]" << errors;
     return errors;
 }
 
@@ -87,42 +122,792 @@ bool Database::hasFeature(int feature) {
     return m_query.driver()->hasFeature((QSqlDriver::DriverFeature)feature);
 }
 
-QVariantMap Database::run(QString querystring) {
-    qDebug() << "[Database::run] start" << querystring;
+QVariantMap Database::lastErrors(QSqlError error) {
+    QVariantMap errors;
+    errors.insert("driver", error.driverText());
+    errors.insert("db", error.databaseText());
+    return errors;
+}
+
+/* Javascript numbers are doubles and cannot represent integers beyond
+ * 2^53 exactly, so such integers are returned as strings. Other types are
+ * passed through unchanged.
+ */
+QVariant Database::toJsValue(QVariant value) {
+    switch (value.type()) {
+    case QVariant::LongLong:
+    case QVariant::Int: {
+        qlonglong val = value.toLongLong();
+        if (val > pow(2, 53) || val < -pow(2, 53)) {
+            return QString::number(val);
+        }
+        break;
+    }
+    case QVariant::ULongLong:
+    case QVariant::UInt: {
+        qulonglong val = value.toULongLong();
+        if (val > pow(2, 53)) {
+            return QString::number(val);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    return value;
+}
+
+QString Database::typeTag(QVariant value) {
+    if (value.isNull()) return "null";
+    switch (value.type()) {
+    case QVariant::LongLong:
+    case QVariant::ULongLong:
+    case QVariant::Int:
+    case QVariant::UInt:
+        return "integer";
+    case QVariant::Double:
+        return "real";
+    case QVariant::ByteArray:
+        return "blob";
+    default:
+        return "text";
+    }
+}
+
+QVariantMap Database::recordToMap(QSqlRecord record) {
+    QVariantMap map;
+    for(int index = 0; index < record.count(); ++index) {
+        map.insert(record.fieldName(index), toJsValue(record.value(index)));
+    }
+    return map;
+}
+
+/* Binds one parameter set to a prepared query. A QVariantList binds
+ * positional placeholders (?), a QVariantMap binds named placeholders
+ * (:name), with or without the leading colon in the key.
+ */
+void Database::bindParams(QSqlQuery &query, QVariant params) {
+    if (params.type() == QVariant::Map) {
+        QVariantMap map = params.toMap();
+        QMapIterator<QString, QVariant> it(map);
+        while (it.hasNext()) {
+            it.next();
+            QString placeholder = it.key();
+            if (!placeholder.startsWith(":")) placeholder.prepend(":");
+            query.bindValue(placeholder, it.value());
+        }
+    } else if (params.type() == QVariant::List) {
+        QVariantList list = params.toList();
+        for (int i = 0; i < list.length(); i++) {
+            query.bindValue(i, list.at(i));
+        }
+    }
+}
+
+/* Executes one statement on the given query and collects all rows. Without
+ * params the statement is executed directly, otherwise it is prepared and
+ * the params are bound (see bindParams).
+ */
+QVariantMap Database::execQuery(QSqlQuery &query, QString querystring, QVariantList params, QueryStats *stats) {
     QVariantMap result;
     QVariantMap errors;
     QVariantList view;
+    QElapsedTimer timer;
+    timer.start();
 
-    m_query.clear();
-    bool success = m_query.exec(querystring);
+    bool success;
+    query.clear();
+    if (params.isEmpty()) {
+        success = query.exec(querystring);
+    } else {
+        success = query.prepare(querystring);
+        if (success) {
+            bindParams(query, params);
+            success = query.exec();
+        }
+    }
 
     if(success) {
-        while (m_query.next()) {
-            QSqlRecord record= m_query.record();
-            QVariantMap map;
-            for(int index = 0; index < record.count(); ++index) {
-                QString key = record.fieldName(index);
-                QVariant value = record.value(index);
-                qulonglong val = value.toULongLong();
-                if (val > pow(2, 53)) {
-                    // return as string. javascript doesn't support more than 2^53
-                    QString string;
-                    string.setNum(val);
-                    value = string;
-                }
-                map.insert(key, value);
-            }
-            view.append(map);
+        while (query.next()) {
+            view.append(recordToMap(query.record()));
         }
-        result.insert("last_insert_id", m_query.lastInsertId());
+        result.insert("last_insert_id", query.lastInsertId());
+        recordStats(stats, query, querystring, params, timer.nsecsElapsed());
     } else {
-        errors.insert("driver", m_query.lastError().driverText());
-        errors.insert("db", m_query.lastError().databaseText());
+        errors = lastErrors(query.lastError());
     }
     result.insert("success", success);
     result.insert("view", view);
     result.insert("errors", errors);
     result.insert("query", querystring);
-    result.insert("numRowsAffected", m_query.numRowsAffected());
+    result.insert("numRowsAffected", query.numRowsAffected());
+    return result;
+}
+
+/* Like execQuery, but returns the rows column by column: "columns" holds
+ * the column names once, "types" a type tag per column (taken from the
+ * first non-null value, as SQLite columns are dynamically typed) and
+ * "data" one array of values per column. This avoids repeating every
+ * column name in every row.
+ */
+QVariantMap Database::execQueryColumnar(QSqlQuery &query, QString querystring, QVariantList params, QueryStats *stats) {
+    QElapsedTimer timer;
+    timer.start();
+    QVariantMap result;
+    QVariantMap errors;
+    QVariantList columns;
+    QVariantList types;
+    QList<QVariantList> data;
+    int rows = 0;
+
+    bool success;
+    query.clear();
+    if (params.isEmpty()) {
+        success = query.exec(querystring);
+    } else {
+        success = query.prepare(querystring);
+        if (success) {
+            bindParams(query, params);
+            success = query.exec();
+        }
+    }
+
+    if (success) {
+        QSqlRecord record = query.record();
+        int count = record.count();
+        for (int index = 0; index < count; ++index) {
+            columns.append(record.fieldName(index));
+            types.append("null");
+            data.append(QVariantList());
+        }
+        while (query.next()) {
+            for (int index = 0; index < count; ++index) {
+                QVariant value = query.value(index);
+                if (types.at(index) == "null") types[index] = typeTag(value);
+                data[index].append(toJsValue(value));
+            }
+            rows++;
+        }
+        result.insert("last_insert_id", query.lastInsertId());
+        recordStats(stats, query, querystring, params, timer.nsecsElapsed());
+    } else {
+        errors = lastErrors(query.lastError());
+    }
+
+    QVariantList columns_data;
+    foreach (QVariantList column, data) {
+        columns_data.append(QVariant(column));
+    }
+    result.insert("success", success);
+    result.insert("columns", columns);
+    result.insert("types", types);
+    result.insert("data", columns_data);
+    result.insert("rows", rows);
+    result.insert("errors", errors);
+    result.insert("query", querystring);
+    result.insert("numRowsAffected", query.numRowsAffected());
+    return result;
+}
+
+QVariantMap Database::runColumnar(QString querystring, QVariantList params) {
+    PLOG(lcDb, 2) << "[Database::runColumnar]" << m_label << querystring;
+    return execQueryColumnar(m_query, querystring, params, m_stats);
+}
+
+QVariantMap Database::run(QString querystring, QVariantList params) {
+    PLOG(lcDb, 3) << "[Database::run] start" << querystring;
+    return execQuery(m_query, querystring, params, m_stats);
+}
+
+QVariantMap Database::begin() {
+    QVariantMap errors;
+    if (m_in_transaction) {
+        errors.insert("db", "alreadyInTransaction");
+    } else if (m_db.transaction()) {
+        m_in_transaction = true;
+    } else {
+        errors = lastErrors(m_db.lastError());
+    }
+    PLOG(lcDb, 1) << "[Database::begin]" << m_label << errors;
+    return errors;
+}
+
+QVariantMap Database::commit() {
+    QVariantMap errors;
+    if (!m_in_transaction) {
+        errors.insert("db", "notInTransaction");
+    } else if (m_db.commit()) {
+        m_in_transaction = false;
+    } else {
+        errors = lastErrors(m_db.lastError());
+    }
+    PLOG(lcDb, 1) << "[Database::commit]" << m_label << errors;
+    return errors;
+}
+
+QVariantMap Database::rollback() {
+    QVariantMap errors;
+    if (!m_in_transaction) {
+        errors.insert("db", "notInTransaction");
+    } else {
+        if (!m_db.rollback()) errors = lastErrors(m_db.lastError());
+        m_in_transaction = false;
+    }
+    PLOG(lcDb, 1) << "[Database::rollback]" << m_label << errors;
+    return errors;
+}
+
+/* Executes many statements inside a single transaction and returns one
+ * aggregated result. With a single statement and a list of parameter sets,
+ * the statement is prepared once and executed for every set. Otherwise
+ * statements[i] is executed with params[i] (if given). On the first failure
+ * the batch is rolled back, unless own_transaction is false (the batch runs
+ * inside a transaction opened with begin()), in which case the caller decides.
+ */
+QVariantMap Database::execBatch(QSqlDatabase db, QStringList statements, QVariantList params, bool own_transaction, QueryStats *stats) {
+    QVariantMap result;
+    QVariantMap errors;
+
+    int count = params.isEmpty() ? statements.length() : params.length();
+    if (statements.isEmpty() || (statements.length() != 1 && statements.length() != count)) {
+        errors.insert("db", "statementsParamsMismatch");
+        result.insert("success", false);
+        result.insert("errors", errors);
+        return result;
+    }
+
+    if (own_transaction && !db.transaction()) {
+        result.insert("success", false);
+        result.insert("errors", lastErrors(db.lastError()));
+        return result;
+    }
+
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    QString prepared;
+    bool success = true;
+    qint64 rows_affected = 0;
+    int index;
+    QElapsedTimer timer;
+
+    for (index = 0; index < count; index++) {
+        QString statement = statements.length() == 1 ? statements.at(0) : statements.at(index);
+        timer.start();
+        if (statement != prepared) {
+            success = query.prepare(statement);
+            if (!success) break;
+            prepared = statement;
+        }
+        QVariant statement_params = params.isEmpty() ? QVariant() : params.at(index);
+        bindParams(query, statement_params);
+        success = query.exec();
+        if (!success) break;
+        recordStats(stats, query, statement, statement_params, timer.nsecsElapsed());
+        if (query.numRowsAffected() > 0) rows_affected += query.numRowsAffected();
+    }
+
+    if (!success) {
+        errors = lastErrors(query.lastError());
+        errors.insert("index", index);
+        if (own_transaction) db.rollback();
+    } else if (own_transaction && !db.commit()) {
+        success = false;
+        errors = lastErrors(db.lastError());
+        db.rollback();
+    }
+
+    result.insert("success", success);
+    result.insert("errors", errors);
+    result.insert("executed", success ? count : index);
+    result.insert("numRowsAffected", rows_affected);
+    result.insert("last_insert_id", query.lastInsertId());
+    return result;
+}
+
+QVariantMap Database::runBatch(QStringList statements, QVariantList params) {
+    PLOG(lcDb, 1) << "[Database::runBatch] start" << m_label << statements.length() << params.length();
+    QVariantMap result = execBatch(m_db, statements, params, !m_in_transaction, m_stats);
+    PLOG(lcDb, 1) << "[Database::runBatch] done" << m_label << result.value("success");
+    return result;
+}
+
+/* Executes a query and keeps the result set open on the C++ side, so that
+ * JavaScript can page through it with fetch() without materializing all
+ * rows at once. The cursor is closed automatically when exhausted.
+ */
+QVariantMap Database::openCursor(QString querystring, QVariantList params) {
+    PLOG(lcDb, 1) << "[Database::openCursor]" << m_label << querystring;
+    QVariantMap result;
+
+    QSqlQuery *query = new QSqlQuery(m_db);
+    query->setForwardOnly(true);
+    QElapsedTimer timer;
+    timer.start();
+
+    bool success = query->prepare(querystring);
+    if (success) {
+        bindParams(*query, params);
+        success = query->exec();
+    }
+    if (success) recordStats(m_stats, *query, querystring, params, timer.nsecsElapsed());
+
+    if (!success) {
+        result.insert("errors", lastErrors(query->lastError()));
+        delete query;
+    } else {
+        m_cursorID++;
+        m_cursors.insert(m_cursorID, query);
+        result.insert("cursor", m_cursorID);
+        result.insert("errors", QVariantMap());
+    }
+    result.insert("success", success);
+    result.insert("query", querystring);
+    return result;
+}
+
+QVariantMap Database::fetch(int cursor, int count) {
+    PLOG(lcDb, 2) << "[Database::fetch]" << m_label << cursor << count;
+    QVariantMap result;
+    QVariantList view;
+
+    QSqlQuery *query = m_cursors.value(cursor, NULL);
+    if (!query) {
+        QVariantMap errors;
+        errors.insert("db", "noSuchCursor");
+        result.insert("success", false);
+        result.insert("errors", errors);
+        result.insert("view", view);
+        result.insert("done", true);
+        return result;
+    }
+
+    bool done = false;
+    while (view.length() < count) {
+        if (!query->next()) {
+            done = true;
+            break;
+        }
+        view.append(recordToMap(query->record()));
+    }
+    if (done) closeCursor(cursor);
+
+    result.insert("success", true);
+    result.insert("errors", QVariantMap());
+    result.insert("view", view);
+    result.insert("done", done);
     return result;
 }
+
+void Database::closeCursor(int cursor) {
+    PLOG(lcDb, 2) << "[Database::closeCursor]" << m_label << cursor;
+    QSqlQuery *query = m_cursors.take(cursor);
+    if (!query) return;
+    query->finish();
+    delete query;
+}
+
+DatabaseWorker *Database::createWorker(QString connection_name, bool read_only) {
+    QThread *thread = new QThread(this);
+    DatabaseWorker *worker = new DatabaseWorker(connection_name, m_dbpath, m_profile, read_only, m_stats);
+    worker->moveToThread(thread);
+    connect(worker, &DatabaseWorker::finished, this, &Database::finished);
+    thread->start();
+    QMetaObject::invokeMethod(worker, "open", Qt::QueuedConnection);
+    PLOG(lcDb, 0) << "[Database::createWorker]" << connection_name << read_only;
+    return worker;
+}
+
+void Database::destroyWorker(DatabaseWorker *worker) {
+    QThread *thread = worker->thread();
+    QMetaObject::invokeMethod(worker, "close", Qt::BlockingQueuedConnection);
+    thread->quit();
+    thread->wait();
+    delete worker;
+    delete thread;
+}
+
+/* Starts the worker thread on first use. The worker opens its own
+ * connection to the same database file, so asynchronous queries never
+ * block the GUI thread.
+ */
+bool Database::startWorker() {
+    if (m_worker) return true;
+    if (!m_is_setup) return false;
+    m_worker = createWorker(m_connection_name + "_worker", false);
+    return true;
+}
+
+/* Starts the read-only connections on first use, each in its own thread.
+ */
+bool Database::startReaders() {
+    if (!m_readers.isEmpty()) return true;
+    if (!m_is_setup || m_readPoolSize < 1) return false;
+    for (int i = 0; i < m_readPoolSize; i++) {
+        m_readers.append(createWorker(QString("%1_reader%2").arg(m_connection_name).arg(i), true));
+    }
+    return true;
+}
+
+/* Sets the number of read-only connections used by readAsync(). Must be
+ * called before the first readAsync(). Without WAL (see setProfile)
+ * readers still have to wait for writers.
+ */
+bool Database::setReadPoolSize(int size) {
+    if (!m_readers.isEmpty() || size < 0) return false;
+    m_readPoolSize = size;
+    return true;
+}
+
+/* Like runAsync, but executed on one of the read-only connections, picked
+ * round-robin. Reads on different connections run concurrently, so their
+ * results may arrive in a different order than they were issued. Falls
+ * back to the ordered worker when no read pool is configured.
+ */
+qint64 Database::readAsync(QString querystring, QVariantList params) {
+    if (!startReaders()) return runAsync(querystring, params);
+    m_requestID++;
+    DatabaseWorker *reader = m_readers.at(m_nextReader);
+    m_nextReader = (m_nextReader + 1) % m_readers.length();
+    PLOG(lcDb, 1) << "[Database::readAsync]" << m_label << m_requestID << querystring;
+    QMetaObject::invokeMethod(reader, "run", Qt::QueuedConnection,
+                              Q_ARG(qint64, m_requestID),
+                              Q_ARG(QString, querystring),
+                              Q_ARG(QVariantList, params));
+    return m_requestID;
+}
+
+/* Queues a query on the worker thread and returns a request ID at once.
+ * The result is delivered by the finished(id, result) signal. Requests
+ * of one Database complete in the order they were issued.
+ */
+qint64 Database::runAsync(QString querystring, QVariantList params) {
+    if (!startWorker()) return -1;
+    m_requestID++;
+    PLOG(lcDb, 1) << "[Database::runAsync]" << m_label << m_requestID << querystring;
+    QMetaObject::invokeMethod(m_worker, "run", Qt::QueuedConnection,
+                              Q_ARG(qint64, m_requestID),
+                              Q_ARG(QString, querystring),
+                              Q_ARG(QVariantList, params));
+    return m_requestID;
+}
+
+qint64 Database::runBatchAsync(QStringList statements, QVariantList params) {
+    if (!startWorker()) return -1;
+    m_requestID++;
+    PLOG(lcDb, 1) << "[Database::runBatchAsync]" << m_label << m_requestID << statements.length();
+    QMetaObject::invokeMethod(m_worker, "runBatch", Qt::QueuedConnection,
+                              Q_ARG(qint64, m_requestID),
+                              Q_ARG(QStringList, statements),
+                              Q_ARG(QVariantList, params));
+    return m_requestID;
+}
+
+QStringList Database::profiles() {
+    QStringList names;
+    names << "default" << "wal" << "safe" << "fast";
+    return names;
+}
+
+/* Returns the PRAGMA statements making up a named performance profile.
+ *
+ * default: SQLite defaults (rollback journal, synchronous=FULL)
+ * wal:     write-ahead log, so readers proceed while history is written,
+ *          synchronous=NORMAL, 16 MiB page cache, 256 MiB mmap
+ * safe:    write-ahead log with synchronous=FULL
+ * fast:    in-memory journal, no syncing. Only for throwaway databases.
+ *
+ * WAL does not work on network file systems; keep "default" there.
+ */
+static QStringList profilePragmas(QString profile) {
+    QStringList pragmas;
+    if (profile == "wal") {
+        pragmas << "PRAGMA journal_mode=WAL"
+                << "PRAGMA synchronous=NORMAL"
+                << "PRAGMA cache_size=-16384"
+                << "PRAGMA mmap_size=268435456"
+                << "PRAGMA temp_store=MEMORY"
+                << "PRAGMA busy_timeout=5000";
+    } else if (profile == "safe") {
+        pragmas << "PRAGMA journal_mode=WAL"
+                << "PRAGMA synchronous=FULL"
+                << "PRAGMA busy_timeout=5000";
+    } else if (profile == "fast") {
+        pragmas << "PRAGMA journal_mode=MEMORY"
+                << "PRAGMA synchronous=OFF"
+                << "PRAGMA cache_size=-32768"
+                << "PRAGMA mmap_size=268435456"
+                << "PRAGMA temp_store=MEMORY";
+    }
+    return pragmas;
+}
+
+/* Failed pragmas are reported in the usual {db, driver} error shape,
+ * joined into one message.
+ */
+QVariantMap Database::applyProfile(QSqlDatabase db, QString profile) {
+    QVariantMap errors;
+    QStringList failed_db;
+    QStringList failed_driver;
+    QSqlQuery query(db);
+    foreach (QString pragma, profilePragmas(profile)) {
+        // keep going: e.g. journal_mode cannot be changed on a read-only
+        // connection, but the cache settings still apply
+        if (!query.exec(pragma)) {
+            failed_db.append(pragma + ": " + query.lastError().databaseText());
+            failed_driver.append(query.lastError().driverText());
+        }
+    }
+    if (!failed_db.isEmpty()) {
+        errors.insert("db", failed_db.join("; "));
+        errors.insert("driver", failed_driver.join("; "));
+    }
+    PLOG(lcDb, 1) << "[Database::applyProfile]" << profile << errors;
+    return errors;
+}
+
+/* Must be called before open(). The default comes from the db_profile
+ * configuration key.
+ */
+bool Database::setProfile(QString profile) {
+    if (!profiles().contains(profile)) return false;
+    m_profile = profile;
+    return true;
+}
+
+QString Database::getProfile() {
+    return m_profile;
+}
+
+/* Times a typical history workload against a scratch database file with
+ * the given profile: single inserts in autocommit mode, one batched
+ * insert of all rows, and an indexed range query. Times are in ms.
+ */
+QVariantMap Database::benchmark(QString dbpath, QString profile, int rows) {
+    QVariantMap result;
+    QString connection_name = "benchmark_" + profile;
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connection_name);
+        db.setDatabaseName(dbpath);
+        if (!db.open()) {
+            result.insert("errors", lastErrors(db.lastError()));
+            return result;
+        }
+        applyProfile(db, profile);
+
+        QSqlQuery query(db);
+        query.exec("CREATE TABLE history (id INTEGER PRIMARY KEY, ts INTEGER, sender TEXT, body TEXT)");
+        query.exec("CREATE INDEX history_ts ON history (ts)");
+
+        QElapsedTimer timer;
+        int single_rows = qMin(rows, 1000);
+        timer.start();
+        query.prepare("INSERT INTO history (ts, sender, body) VALUES (?, ?, ?)");
+        for (int i = 0; i < single_rows; i++) {
+            query.bindValue(0, i);
+            query.bindValue(1, "benchmark");
+            query.bindValue(2, "The quick brown fox jumps over the lazy dog");
+            query.exec();
+        }
+        result.insert("insert_autocommit_rows", single_rows);
+        result.insert("insert_autocommit_ms", timer.elapsed());
+
+        QVariantList params;
+        for (int i = 0; i < rows; i++) {
+            QVariantList row;
+            row << single_rows + i << "benchmark" << "The quick brown fox jumps over the lazy dog";
+            params.append(QVariant(row));
+        }
+        timer.restart();
+        execBatch(db, QStringList("INSERT INTO history (ts, sender, body) VALUES (?, ?, ?)"), params, true);
+        result.insert("insert_batch_rows", rows);
+        result.insert("insert_batch_ms", timer.elapsed());
+
+        timer.restart();
+        QSqlQuery select(db);
+        select.setForwardOnly(true);
+        execQuery(select, "SELECT * FROM history WHERE ts > ? ORDER BY ts DESC LIMIT 1000", QVariantList() << rows / 2);
+        result.insert("select_ms", timer.elapsed());
+
+        select.finish();
+        query.finish();
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(connection_name);
+    QFile::remove(dbpath);
+    QFile::remove(dbpath + "-wal");
+    QFile::remove(dbpath + "-shm");
+    QFile::remove(dbpath + "-journal");
+    result.insert("profile", profile);
+    return result;
+}
+
+/* ----------- Full-text search begin ----------------- */
+
+bool Database::isIdentifier(QString name) {
+    return QRegExp("[A-Za-z_][A-Za-z0-9_]*").exactMatch(name);
+}
+
+/* Creates an FTS5 index <table>_fts over the given columns of a message
+ * table. The index uses the table as external content, so text is not
+ * stored twice, and triggers keep it in sync on every insert, update and
+ * delete. When the index is created for the first time, existing rows are
+ * indexed once. Safe to call on every start.
+ */
+QVariantMap Database::searchSetup(QString table, QStringList columns) {
+    PLOG(lcDb, 1) << "[Database::searchSetup]" << m_label << table << columns;
+    QVariantMap result;
+
+    bool valid = isIdentifier(table) && !columns.isEmpty();
+    foreach (QString column, columns) {
+        if (!isIdentifier(column)) valid = false;
+    }
+    if (!valid) {
+        QVariantMap errors;
+        errors.insert("db", "invalidIdentifier");
+        result.insert("success", false);
+        result.insert("errors", errors);
+        return result;
+    }
+
+    QString fts = table + "_fts";
+    QStringList new_columns;
+    QStringList old_columns;
+    foreach (QString column, columns) {
+        new_columns.append("new." + column);
+        old_columns.append("old." + column);
+    }
+    QString cols = columns.join(", ");
+    QString insert_new = QString("INSERT INTO %1(rowid, %2) VALUES (new.rowid, %3);").arg(fts, cols, new_columns.join(", "));
+    QString delete_old = QString("INSERT INTO %1(%1, rowid, %2) VALUES ('delete', old.rowid, %3);").arg(fts, cols, old_columns.join(", "));
+
+    QSqlQuery query(m_db);
+    query.prepare("SELECT name FROM sqlite_master WHERE type = 'table' AND name = ?");
+    query.bindValue(0, fts);
+    query.exec();
+    bool exists = query.next();
+    query.finish();
+
+    QStringList statements;
+    statements << QString("CREATE VIRTUAL TABLE IF NOT EXISTS %1 USING fts5(%2, content='%3')").arg(fts, cols, table)
+               << QString("CREATE TRIGGER IF NOT EXISTS %1_ai AFTER INSERT ON %2 BEGIN %3 END").arg(fts, table, insert_new)
+               << QString("CREATE TRIGGER IF NOT EXISTS %1_ad AFTER DELETE ON %2 BEGIN %3 END").arg(fts, table, delete_old)
+               << QString("CREATE TRIGGER IF NOT EXISTS %1_au AFTER UPDATE ON %2 BEGIN %3 %4 END").arg(fts, table, delete_old, insert_new);
+    if (!exists) {
+        statements << QString("INSERT INTO %1(%1) VALUES ('rebuild')").arg(fts);
+    }
+
+    result = execBatch(m_db, statements, QVariantList(), !m_in_transaction, m_stats);
+    result.insert("rebuilt", !exists);
+    PLOG(lcDb, 1) << "[Database::searchSetup] done" << m_label << result;
+    return result;
+}
+
+/* Turns what the user typed into an FTS5 query: every word becomes a
+ * quoted prefix term, so partial words match while typing and FTS5
+ * syntax characters in the input cannot cause errors.
+ */
+QString Database::searchMatchExpression(QString input) {
+    QStringList terms;
+    foreach (QString word, input.split(QRegExp("\\s+"), QString::SkipEmptyParts)) {
+        word.replace("\"", "\"\"");
+        terms.append("\"" + word + "\"*");
+    }
+    return terms.join(" ");
+}
+
+/* Returns the rows of the message table, best match first, with the
+ * additional columns "snippet" and "rank". In the snippet, matched terms
+ * are enclosed in the control characters \x02 and \x03, so that the UI
+ * can HTML-escape the text before inserting its own highlighting.
+ */
+QString Database::searchStatement(QString table) {
+    QString fts = table + "_fts";
+    return QString("SELECT %1.*, snippet(%2, -1, char(2), char(3), '...', 16) AS snippet, bm25(%2) AS rank "
+                   "FROM %2 JOIN %1 ON %1.rowid = %2.rowid "
+                   "WHERE %2 MATCH ? ORDER BY rank LIMIT ? OFFSET ?").arg(table, fts);
+}
+
+QVariantMap Database::search(QString table, QString input, int limit, int offset, bool raw) {
+    PLOG(lcDb, 1) << "[Database::search]" << m_label << table << input;
+    if (!isIdentifier(table)) {
+        QVariantMap result;
+        QVariantMap errors;
+        errors.insert("db", "invalidIdentifier");
+        result.insert("success", false);
+        result.insert("errors", errors);
+        return result;
+    }
+    QString match = raw ? input : searchMatchExpression(input);
+    if (match.trimmed().isEmpty()) {
+        // an empty MATCH is an FTS5 syntax error; nothing typed, nothing found
+        QVariantMap result;
+        result.insert("success", true);
+        result.insert("view", QVariantList());
+        result.insert("errors", QVariantMap());
+        result.insert("query", searchStatement(table));
+        result.insert("numRowsAffected", 0);
+        return result;
+    }
+    QVariantList params;
+    params << match << limit << offset;
+
+    QSqlQuery query(m_db);
+    query.setForwardOnly(true);
+    return execQuery(query, searchStatement(table), params, m_stats);
+}
+
+qint64 Database::searchAsync(QString table, QString input, int limit, int offset, bool raw) {
+    if (!isIdentifier(table)) return -1;
+    QString match = raw ? input : searchMatchExpression(input);
+    if (match.trimmed().isEmpty()) {
+        // still queued, so that results keep arriving in request order
+        return runAsync("SELECT NULL WHERE 0", QVariantList());
+    }
+    QVariantList params;
+    params << match << limit << offset;
+    return runAsync(searchStatement(table), params);
+}
+
+/* ----------- Full-text search end ----------------- */
+
+/* ----------- Query statistics begin ----------------- */
+
+/* Records the timing of one statement. For statements over the slow query
+ * threshold, EXPLAIN QUERY PLAN is run on the same connection with the
+ * same parameters, and the plan is stored with the slow-query log entry.
+ */
+void Database::recordStats(QueryStats *stats, QSqlQuery &query, QString statement, QVariant params, qint64 nsecs) {
+    if (!stats) return;
+    QVariantList plan;
+    if (stats->isSlow(nsecs) && query.driver()) {
+        QSqlQuery explain(query.driver()->createResult());
+        explain.setForwardOnly(true);
+        if (explain.prepare("EXPLAIN QUERY PLAN " + statement)) {
+            bindParams(explain, params);
+            if (explain.exec()) {
+                while (explain.next()) {
+                    plan.append(explain.record().value("detail"));
+                }
+            }
+        }
+    }
+    stats->record(statement, nsecs, plan);
+}
+
+QVariantMap Database::stats() {
+    return m_stats->stats();
+}
+
+QVariantList Database::slowQueries() {
+    return m_stats->slowQueries();
+}
+
+void Database::resetStats() {
+    m_stats->reset();
+}
+
+void Database::setSlowQueryThreshold(int ms) {
+    m_stats->setSlowThreshold(ms);
+}
+
+/* ----------- Query statistics end ----------------- */
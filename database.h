@@ -28,6 +28,12 @@
 #include <QSqlDriver>
 #include <QVariantMap>
 #include <QSqlQuery>
+#include <QSqlRecord>
+#include <QSqlError>
+#include <QStringList>
+#include <QMap>
+#include <QList>
+#include <QThread>
 #include <QSettings>
 
 
@@ -35,6 +41,8 @@ extern QString home_path;
 extern QString jail_working_path;
 extern QSettings *settings;
 
+class DatabaseWorker;
+class QueryStats;
 
 class Database : public QObject
 {
@@ -43,6 +51,16 @@ public:
     explicit Database(QString label, QObject *parent = 0);
     ~Database();
 
+    static QVariantMap execQuery(QSqlQuery &query, QString querystring, QVariantList params = QVariantList(), QueryStats *stats = NULL);
+    static QVariantMap execQueryColumnar(QSqlQuery &query, QString querystring, QVariantList params = QVariantList(), QueryStats *stats = NULL);
+    static QVariantMap execBatch(QSqlDatabase db, QStringList statements, QVariantList params, bool own_transaction, QueryStats *stats = NULL);
+    static QStringList profiles();
+    static QVariantMap applyProfile(QSqlDatabase db, QString profile);
+    static QVariantMap benchmark(QString dbpath, QString profile, int rows);
+    static bool isIdentifier(QString name);
+    static QString searchStatement(QString table);
+    static QString searchMatchExpression(QString input);
+
 protected:
 
 private:
@@ -50,14 +68,58 @@ private:
     QSqlQuery m_query;
     bool m_is_setup;
     QString m_label;
+    bool m_in_transaction;
+    QMap<int, QSqlQuery *> m_cursors;
+    int m_cursorID;
+    QString m_dbpath;
+    QString m_connection_name;
+    DatabaseWorker *m_worker;
+    QList<DatabaseWorker *> m_readers;
+    int m_readPoolSize;
+    int m_nextReader;
+    qint64 m_requestID;
+    QString m_profile;
+    QueryStats *m_stats;
     // methods
+    DatabaseWorker *createWorker(QString connection_name, bool read_only);
+    void destroyWorker(DatabaseWorker *worker);
+    bool startWorker();
+    bool startReaders();
+    static QVariantMap lastErrors(QSqlError error);
+    static QVariant toJsValue(QVariant value);
+    static QString typeTag(QVariant value);
+    static QVariantMap recordToMap(QSqlRecord record);
+    static void bindParams(QSqlQuery &query, QVariant params);
+    static void recordStats(QueryStats *stats, QSqlQuery &query, QString statement, QVariant params, qint64 nsecs);
 
 signals:
+    void finished(qint64 id, QVariantMap result);
 
 public slots:
     QVariantMap open();
     void close();
-    QVariantMap run(QString querystring);
+    QVariantMap run(QString querystring, QVariantList params = QVariantList());
+    QVariantMap runColumnar(QString querystring, QVariantList params = QVariantList());
+    QVariantMap runBatch(QStringList statements, QVariantList params = QVariantList());
+    QVariantMap begin();
+    QVariantMap commit();
+    QVariantMap rollback();
+    QVariantMap openCursor(QString querystring, QVariantList params = QVariantList());
+    QVariantMap fetch(int cursor, int count = 100);
+    void closeCursor(int cursor);
+    qint64 runAsync(QString querystring, QVariantList params = QVariantList());
+    qint64 runBatchAsync(QStringList statements, QVariantList params = QVariantList());
+    bool setReadPoolSize(int size);
+    qint64 readAsync(QString querystring, QVariantList params = QVariantList());
+    QVariantMap searchSetup(QString table, QStringList columns);
+    QVariantMap search(QString table, QString input, int limit = 50, int offset = 0, bool raw = false);
+    qint64 searchAsync(QString table, QString input, int limit = 50, int offset = 0, bool raw = false);
+    bool setProfile(QString profile);
+    QString getProfile();
+    QVariantMap stats();
+    QVariantList slowQueries();
+    void resetStats();
+    void setSlowQueryThreshold(int ms);
     bool isOpen();
     bool hasFeature(int feature);
     void setup(QString dbpath);
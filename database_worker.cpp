@@ -0,0 +1,73 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "database_worker.h"
+#include "logging.h"
+#include "database.h"
+
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QDebug>
+
+DatabaseWorker::DatabaseWorker(QString connection_name, QString dbpath, QString profile, bool read_only, QueryStats *stats) :
+    QObject(0)
+{
+    m_connection_name = connection_name;
+    m_dbpath = dbpath;
+    m_profile = profile;
+    m_read_only = read_only;
+    m_stats = stats;
+}
+
+DatabaseWorker::~DatabaseWorker() {
+    PLOG(lcDb, 0) << "[DatabaseWorker::~DatabaseWorker]" << m_connection_name;
+}
+
+void DatabaseWorker::open() {
+    m_db = QSqlDatabase::addDatabase("QSQLITE", m_connection_name);
+    m_db.setDatabaseName(m_dbpath);
+    if (m_read_only) m_db.setConnectOptions("QSQLITE_OPEN_READONLY");
+    bool success = m_db.open();
+    if (success) Database::applyProfile(m_db, m_profile);
+    PLOG(lcDb, 0) << "[DatabaseWorker::open]" << m_connection_name << success << m_db.lastError().databaseText();
+}
+
+void DatabaseWorker::close() {
+    PLOG(lcDb, 0) << "[DatabaseWorker::close]" << m_connection_name;
+    m_db.close();
+    m_db = QSqlDatabase();
+    QSqlDatabase::removeDatabase(m_connection_name);
+}
+
+void DatabaseWorker::run(qint64 id, QString querystring, QVariantList params) {
+    PLOG(lcDb, 2) << "[DatabaseWorker::run]" << m_connection_name << id << querystring;
+    QSqlQuery query(m_db);
+    query.setForwardOnly(true);
+    QVariantMap result = Database::execQuery(query, querystring, params, m_stats);
+    emit finished(id, result);
+}
+
+void DatabaseWorker::runBatch(qint64 id, QStringList statements, QVariantList params) {
+    PLOG(lcDb, 2) << "[DatabaseWorker::runBatch]" << m_connection_name << id << statements.length();
+    QVariantMap result = Database::execBatch(m_db, statements, params, true, m_stats);
+    emit finished(id, result);
+}
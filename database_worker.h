@@ -0,0 +1,63 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef DATABASE_WORKER_H
+#define DATABASE_WORKER_H
+
+#include <QObject>
+#include <QSqlDatabase>
+#include <QVariantMap>
+#include <QStringList>
+
+class QueryStats;
+
+/* Owns a private SQLite connection and executes queries on behalf of a
+ * Database object. It lives in its own thread; slots are invoked through
+ * queued connections, so requests are processed strictly in the order
+ * they were issued.
+ */
+class DatabaseWorker : public QObject
+{
+    Q_OBJECT
+public:
+    explicit DatabaseWorker(QString connection_name, QString dbpath, QString profile, bool read_only = false, QueryStats *stats = NULL);
+    ~DatabaseWorker();
+
+private:
+    QString m_connection_name;
+    QString m_dbpath;
+    QString m_profile;
+    bool m_read_only;
+    QueryStats *m_stats;
+    QSqlDatabase m_db;
+
+signals:
+    void finished(qint64 id, QVariantMap result);
+
+public slots:
+    void open();
+    void close();
+    void run(qint64 id, QString querystring, QVariantList params);
+    void runBatch(qint64 id, QStringList statements, QVariantList params);
+};
+
+#endif // DATABASE_WORKER_H
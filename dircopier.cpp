@@ -0,0 +1,214 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "dircopier.h"
+#include "logging.h"
+#include "fileutil.h"
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QSet>
+#include <QtConcurrent>
+#include <QDebug>
+
+#define DIRCOPIER_PROGRESS_INTERVAL 250
+
+struct CopyEntryFunctor
+{
+    typedef void result_type;
+    DirCopier *m_copier;
+    explicit CopyEntryFunctor(DirCopier *copier) : m_copier(copier) {}
+    void operator()(const DirCopier::Entry &entry) { m_copier->copyEntry(entry); }
+};
+
+DirCopier::DirCopier(QObject *parent, QString src_abs, QString dst_abs, bool mirror) :
+    QObject(parent)
+{
+    PLOG(lcFs, 1) << "[DirCopier::DirCopier]" << src_abs << dst_abs << mirror;
+    m_src_abs = QDir(src_abs).absolutePath();
+    m_dst_abs = QDir(dst_abs).absolutePath();
+    m_mirror = mirror;
+    m_bytes_total = 0;
+    m_cancelled = 0;
+}
+
+/* The background copy works on this object, so it is cancelled and
+ * waited for; Javascript may delete a DirCopier at any time.
+ */
+DirCopier::~DirCopier() {
+    PLOG(lcFs, 1) << "[DirCopier::~DirCopier]" << m_dst_abs;
+    cancel();
+    m_future.waitForFinished();
+}
+
+void DirCopier::cancel() {
+    m_cancelled = 1;
+}
+
+/* Creates the directory structure in the destination and collects the
+ * files to copy.
+ */
+bool DirCopier::walk() {
+    m_entries.clear();
+    m_bytes_total = 0;
+
+    QDirIterator it(m_src_abs, QDir::Dirs | QDir::Files | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        it.next();
+        QFileInfo info = it.fileInfo();
+        QString path_rel = info.absoluteFilePath().mid(m_src_abs.length() + 1);
+        if (info.isDir()) {
+            if (!QDir().mkpath(m_dst_abs + "/" + path_rel)) {
+                PLOG(lcFs, 0) << "[DirCopier::walk] cannot create dir" << path_rel;
+                return false;
+            }
+        } else {
+            Entry entry;
+            entry.path_rel = path_rel;
+            entry.size = info.size();
+            entry.mtime = info.lastModified();
+            m_entries.append(entry);
+            m_bytes_total += entry.size;
+        }
+    }
+    return true;
+}
+
+void DirCopier::prune() {
+    QDirIterator it(m_dst_abs, QDir::Dirs | QDir::Files | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+    QStringList obsolete;
+    while (it.hasNext()) {
+        it.next();
+        QString path_rel = it.fileInfo().absoluteFilePath().mid(m_dst_abs.length() + 1);
+        if (!QFileInfo(m_src_abs + "/" + path_rel).exists()) obsolete.append(path_rel);
+    }
+    foreach (QString path_rel, obsolete) {
+        QString path_abs = m_dst_abs + "/" + path_rel;
+        QFileInfo info(path_abs);
+        if (!info.exists()) continue; // inside an already removed directory
+        if (info.isDir()) {
+            QDir(path_abs).removeRecursively();
+        } else {
+            QFile::remove(path_abs);
+        }
+        PLOG(lcFs, 2) << "[DirCopier::prune] removed" << path_rel;
+    }
+}
+
+/* Called concurrently from pool threads.
+ */
+void DirCopier::copyEntry(const Entry &entry) {
+    if (m_cancelled.load()) return;
+
+    QString src = m_src_abs + "/" + entry.path_rel;
+    QString dst = m_dst_abs + "/" + entry.path_rel;
+
+    QFileInfo dst_info(dst);
+    if (dst_info.exists() && dst_info.size() == entry.size && qAbs(dst_info.lastModified().secsTo(entry.mtime)) < 2) {
+        // FAT stores modification times with 2 s resolution
+        m_skipped.fetchAndAddOrdered(1);
+    } else {
+        if (dst_info.exists()) QFile::remove(dst);
+        if (FileUtil::copyFile(src, dst)) {
+            FileUtil::setModificationTime(dst, entry.mtime);
+            m_copied.fetchAndAddOrdered(1);
+        } else {
+            PLOG(lcFs, 0) << "[DirCopier::copyEntry] cannot copy" << src << dst;
+            m_failed.fetchAndAddOrdered(1);
+        }
+    }
+
+    qint64 files_done = m_files_done.fetchAndAddOrdered(1) + 1;
+    qint64 bytes_done = m_bytes_done.fetchAndAddOrdered(entry.size) + entry.size;
+    qint64 now = m_timer.elapsed();
+    qint64 last = m_lastProgress.load();
+    if (now - last >= DIRCOPIER_PROGRESS_INTERVAL && m_lastProgress.testAndSetOrdered(last, now)) {
+        emit progress(files_done, m_entries.length(), bytes_done, m_bytes_total);
+    }
+}
+
+/* Copies synchronously. The file copies still run in parallel; the
+ * calling thread takes part in the work.
+ */
+QVariantMap DirCopier::exec() {
+    QVariantMap info;
+    m_timer.start();
+    m_files_done = 0;
+    m_bytes_done = 0;
+    m_copied = 0;
+    m_skipped = 0;
+    m_failed = 0;
+    m_lastProgress = 0;
+
+    if (!QDir(m_src_abs).exists()) {
+        PLOG(lcFs, 0) << "[DirCopier::exec] src dir not existing";
+        info.insert("status", "Error");
+        info.insert("info", "srcNotExisting");
+        return info;
+    }
+    if (!QDir(m_dst_abs).exists()) {
+        PLOG(lcFs, 0) << "[DirCopier::exec] dst dir not existing";
+        info.insert("status", "Error");
+        info.insert("info", "dstNotExisting");
+        return info;
+    }
+
+    if (!walk()) {
+        info.insert("status", "Error");
+        info.insert("info", "cannotCreateDir");
+        return info;
+    }
+    if (m_mirror) prune();
+
+    QtConcurrent::blockingMap(m_entries, CopyEntryFunctor(this));
+
+    if (m_cancelled.load()) {
+        info.insert("status", "Error");
+        info.insert("info", "cancelled");
+    } else if (m_failed.load() > 0) {
+        info.insert("status", "Error");
+        info.insert("info", "copyFailed");
+    } else {
+        info.insert("status", "OK");
+    }
+    info.insert("files", m_entries.length());
+    info.insert("copied", m_copied.load());
+    info.insert("skipped", m_skipped.load());
+    info.insert("failed", m_failed.load());
+    info.insert("bytes", m_bytes_total);
+    info.insert("ms", m_timer.elapsed());
+    PLOG(lcFs, 1) << "[DirCopier::exec] done" << m_dst_abs << info;
+    return info;
+}
+
+void DirCopier::execAndEmit() {
+    emit finished(exec());
+}
+
+/* Copies in the background; the result is delivered by finished().
+ */
+void DirCopier::run() {
+    if (m_future.isRunning()) return;
+    m_future = QtConcurrent::run(this, &DirCopier::execAndEmit);
+}
@@ -0,0 +1,89 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef DIRCOPIER_H
+#define DIRCOPIER_H
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QVariantMap>
+#include <QList>
+#include <QFuture>
+
+/* Copies a directory tree. The source is walked once, directories are
+ * created up front, and the files are then copied in parallel on the
+ * global QThreadPool using FileUtil::copyFile (reflink/copy_file_range
+ * where available). Files whose size and modification time match the
+ * destination are skipped; copied files get the source modification
+ * time. In mirror mode, files and directories in the destination that
+ * do not exist in the source are removed.
+ */
+class DirCopier : public QObject
+{
+    Q_OBJECT
+public:
+    explicit DirCopier(QObject *parent, QString src_abs, QString dst_abs, bool mirror = false);
+    ~DirCopier();
+
+    struct Entry {
+        QString path_rel;
+        qint64 size;
+        QDateTime mtime;
+    };
+
+    QVariantMap exec();
+    void copyEntry(const Entry &entry);
+
+private:
+    QString m_src_abs;
+    QString m_dst_abs;
+    bool m_mirror;
+    QList<Entry> m_entries;
+    qint64 m_bytes_total;
+    QAtomicInt m_cancelled;
+    QAtomicInteger<qint64> m_files_done;
+    QAtomicInteger<qint64> m_bytes_done;
+    QAtomicInteger<qint64> m_copied;
+    QAtomicInteger<qint64> m_skipped;
+    QAtomicInteger<qint64> m_failed;
+    QAtomicInteger<qint64> m_lastProgress;
+    QElapsedTimer m_timer;
+    QFuture<void> m_future;
+
+    // methods
+    bool walk();
+    void prune();
+    void execAndEmit();
+
+signals:
+    void progress(qint64 files_done, qint64 files_total, qint64 bytes_done, qint64 bytes_total);
+    void finished(QVariantMap info);
+
+public slots:
+    void run();
+    void cancel();
+};
+
+#endif // DIRCOPIER_H
@@ -0,0 +1,297 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "dirstream.h"
+#include "logging.h"
+#include "fileutil.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QtEndian>
+#include <QDebug>
+#include <limits.h>
+
+#define DIRSTREAM_FILE_HEADER 16
+
+DirStreamWriter::DirStreamWriter(QString src_abs) {
+    m_src_abs = QDir(src_abs).absolutePath();
+    m_it = NULL;
+    m_file = NULL;
+    m_remaining = 0;
+    m_walked = false;
+    m_atEnd = false;
+    m_files = 0;
+    m_bytes = 0;
+}
+
+DirStreamWriter::~DirStreamWriter() {
+    closeFile();
+    delete m_it;
+}
+
+bool DirStreamWriter::open() {
+    if (!QDir(m_src_abs).exists()) return false;
+    m_it = new QDirIterator(m_src_abs, QDir::Dirs | QDir::Files | QDir::Hidden | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+    return true;
+}
+
+bool DirStreamWriter::atEnd() {
+    return m_atEnd;
+}
+
+qint64 DirStreamWriter::files() {
+    return m_files;
+}
+
+qint64 DirStreamWriter::bytes() {
+    return m_bytes;
+}
+
+void DirStreamWriter::closeFile() {
+    if (!m_file) return;
+    m_file->close();
+    delete m_file;
+    m_file = NULL;
+}
+
+/* Queues the header of the next entry, or the end record.
+ */
+void DirStreamWriter::next() {
+    while (m_it && m_it->hasNext()) {
+        m_it->next();
+        QFileInfo info = m_it->fileInfo();
+        if (info.isSymLink()) continue;
+        QByteArray name = info.absoluteFilePath().mid(m_src_abs.length() + 1).toUtf8();
+        if (name.length() > 0xFFFF) {
+            PLOG(lcFs, 0) << "[DirStreamWriter::next] name too long, skipping" << info.absoluteFilePath();
+            continue;
+        }
+
+        uchar head[3];
+        head[0] = info.isDir() ? DirStreamDir : DirStreamFile;
+        qToBigEndian<quint16>(name.length(), head + 1);
+
+        if (info.isDir()) {
+            m_pending.append((const char *)head, 3);
+            m_pending.append(name);
+            return;
+        }
+
+        QFile *file = new QFile(info.absoluteFilePath());
+        if (!file->open(QIODevice::ReadOnly)) {
+            PLOG(lcFs, 0) << "[DirStreamWriter::next] cannot open, skipping" << info.absoluteFilePath();
+            delete file;
+            continue;
+        }
+        m_file = file;
+        m_remaining = m_file->size();
+
+        uchar sizes[DIRSTREAM_FILE_HEADER];
+        qToBigEndian<quint64>(m_remaining, sizes);
+        qToBigEndian<qint64>(info.lastModified().toMSecsSinceEpoch(), sizes + 8);
+        m_pending.append((const char *)head, 3);
+        m_pending.append(name);
+        m_pending.append((const char *)sizes, DIRSTREAM_FILE_HEADER);
+        m_files++;
+        return;
+    }
+    m_pending.append((char)DirStreamEnd);
+    m_walked = true;
+}
+
+/* Returns the next at most maxlen bytes of the stream; empty once the
+ * end record has been returned.
+ */
+QByteArray DirStreamWriter::read(qint64 maxlen) {
+    QByteArray out;
+    while (out.length() < maxlen) {
+        if (!m_pending.isEmpty()) {
+            int n = qMin((qint64)m_pending.length(), maxlen - out.length());
+            out.append(m_pending.constData(), n);
+            m_pending.remove(0, n);
+            continue;
+        }
+        if (m_file) {
+            qint64 n = qMin(m_remaining, maxlen - out.length());
+            QByteArray chunk = m_file->read(n);
+            if (chunk.length() < n) {
+                PLOG(lcFs, 0) << "[DirStreamWriter::read] file shrank, padding" << m_file->fileName();
+                chunk.append(QByteArray(n - chunk.length(), 0));
+            }
+            out.append(chunk);
+            m_remaining -= n;
+            m_bytes += n;
+            if (m_remaining == 0) closeFile();
+            continue;
+        }
+        if (m_walked) {
+            m_atEnd = true;
+            break;
+        }
+        next();
+    }
+    return out;
+}
+
+DirStreamReader::DirStreamReader(QString dst_abs) {
+    m_dst_abs = QDir(dst_abs).absolutePath();
+    m_file = NULL;
+    m_remaining = 0;
+    m_mtime = 0;
+    m_atEnd = false;
+    m_files = 0;
+    m_bytes = 0;
+}
+
+DirStreamReader::~DirStreamReader() {
+    if (m_file) {
+        // incomplete
+        m_file->close();
+        m_file->remove();
+        delete m_file;
+    }
+}
+
+bool DirStreamReader::atEnd() {
+    return m_atEnd;
+}
+
+QString DirStreamReader::error() {
+    return m_error;
+}
+
+qint64 DirStreamReader::files() {
+    return m_files;
+}
+
+qint64 DirStreamReader::bytes() {
+    return m_bytes;
+}
+
+/* Length of the header being collected, as far as it is known yet.
+ */
+int DirStreamReader::headerLength() {
+    if (m_header.isEmpty()) return 1;
+    uchar type = m_header.at(0);
+    if (type == DirStreamEnd) return 1;
+    if (m_header.length() < 3) return 3;
+    int length = 3 + qFromBigEndian<quint16>((const uchar *)m_header.constData() + 1);
+    if (type == DirStreamFile) length += DIRSTREAM_FILE_HEADER;
+    return length;
+}
+
+void DirStreamReader::closeFile() {
+    m_file->close();
+    if (m_mtime > 0) FileUtil::setModificationTime(m_file->fileName(), QDateTime::fromMSecsSinceEpoch(m_mtime));
+    delete m_file;
+    m_file = NULL;
+    m_files++;
+}
+
+bool DirStreamReader::processHeader() {
+    uchar type = m_header.at(0);
+    if (type == DirStreamEnd) {
+        m_atEnd = true;
+        return true;
+    }
+    if (type != DirStreamDir && type != DirStreamFile) {
+        m_error = "invalidRecord";
+        return false;
+    }
+
+    quint16 name_len = qFromBigEndian<quint16>((const uchar *)m_header.constData() + 1);
+    QString name = QString::fromUtf8(m_header.constData() + 3, name_len);
+    if (name.isEmpty() || name.startsWith("/") || name.contains("..") || name.contains("\\") || (name.length() > 1 && name.at(1) == ':')) {
+        PLOG(lcFs, 0) << "[DirStreamReader::processHeader] path not allowed" << name;
+        m_error = "pathNotAllowed";
+        return false;
+    }
+    QString path_abs = m_dst_abs + "/" + name;
+
+    if (type == DirStreamDir) {
+        if (!QDir().mkpath(path_abs)) {
+            m_error = "cannotCreateDir";
+            return false;
+        }
+        return true;
+    }
+
+    const uchar *sizes = (const uchar *)m_header.constData() + 3 + name_len;
+    quint64 size = qFromBigEndian<quint64>(sizes);
+    if (size > (quint64)LLONG_MAX) {
+        // would turn negative as qint64 and move write() backwards
+        m_error = "invalidRecord";
+        return false;
+    }
+    m_remaining = (qint64)size;
+    m_mtime = qFromBigEndian<qint64>(sizes + 8);
+    QDir().mkpath(QFileInfo(path_abs).path());
+    m_file = new QFile(path_abs);
+    if (!m_file->open(QIODevice::WriteOnly)) {
+        delete m_file;
+        m_file = NULL;
+        m_error = "cannotOpen";
+        return false;
+    }
+    if (m_remaining == 0) closeFile();
+    return true;
+}
+
+/* Consumes one chunk of the stream. Reading stops at the end record;
+ * bytes after it are not part of the stream and are returned in rest.
+ * Returns false on error, after which the reader accepts no more data.
+ */
+bool DirStreamReader::write(const QByteArray &data, QByteArray *rest) {
+    rest->clear();
+    if (m_error != "") return false;
+
+    int pos = 0;
+    while (pos < data.length()) {
+        if (m_atEnd) {
+            *rest = data.mid(pos);
+            return true;
+        }
+        if (m_file) {
+            qint64 n = qMin(m_remaining, (qint64)(data.length() - pos));
+            if (m_file->write(data.constData() + pos, n) != n) {
+                m_error = "cannotWrite";
+                return false;
+            }
+            pos += n;
+            m_remaining -= n;
+            m_bytes += n;
+            if (m_remaining == 0) closeFile();
+            continue;
+        }
+
+        int n = qMin(headerLength() - m_header.length(), data.length() - pos);
+        m_header.append(data.constData() + pos, n);
+        pos += n;
+        if (m_header.length() == headerLength()) {
+            bool ok = processHeader();
+            m_header.clear();
+            if (!ok) return false;
+        }
+    }
+    return true;
+}
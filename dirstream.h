@@ -0,0 +1,108 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef DIRSTREAM_H
+#define DIRSTREAM_H
+
+#include <QString>
+#include <QByteArray>
+#include <QFile>
+#include <QDirIterator>
+
+/* A directory tree as one byte stream, so that a folder can be sent over
+ * a Client socket without staging an archive on either end. The stream
+ * is a sequence of records:
+ *
+ *   u8 type (1 = directory, 2 = file, 0 = end of stream)
+ *   u16 name length, name (UTF-8, relative, '/' separated)
+ *   files only: u64 size, i64 modification time (ms since epoch), data
+ *
+ * Integers are big-endian. The end record is the type byte alone.
+ */
+enum DirStreamType { DirStreamEnd = 0, DirStreamDir = 1, DirStreamFile = 2 };
+
+/* Produces the stream while walking the source directory, so the first
+ * bytes are available at once. A file that shrinks while being sent is
+ * padded with zeros to the announced size.
+ */
+class DirStreamWriter
+{
+public:
+    explicit DirStreamWriter(QString src_abs);
+    ~DirStreamWriter();
+
+    bool open();
+    QByteArray read(qint64 maxlen);
+    bool atEnd();
+    qint64 files();
+    qint64 bytes();
+
+private:
+    QString m_src_abs;
+    QDirIterator *m_it;
+    QFile *m_file;
+    qint64 m_remaining;
+    QByteArray m_pending;
+    bool m_walked;
+    bool m_atEnd;
+    qint64 m_files;
+    qint64 m_bytes;
+
+    // methods
+    void next();
+    void closeFile();
+};
+
+/* Recreates the tree below dst_abs from stream data in whatever chunks it
+ * arrives. Names that are absolute or contain ".." are rejected and stop
+ * the reader.
+ */
+class DirStreamReader
+{
+public:
+    explicit DirStreamReader(QString dst_abs);
+    ~DirStreamReader();
+
+    bool write(const QByteArray &data, QByteArray *rest);
+    bool atEnd();
+    QString error();
+    qint64 files();
+    qint64 bytes();
+
+private:
+    QString m_dst_abs;
+    QByteArray m_header;
+    QFile *m_file;
+    qint64 m_remaining;
+    qint64 m_mtime;
+    bool m_atEnd;
+    QString m_error;
+    qint64 m_files;
+    qint64 m_bytes;
+
+    // methods
+    int headerLength();
+    bool processHeader();
+    void closeFile();
+};
+
+#endif // DIRSTREAM_H
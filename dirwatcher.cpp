@@ -0,0 +1,182 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "dirwatcher.h"
+#include "logging.h"
+
+#include <QDir>
+#include <QDebug>
+
+#define DIRWATCHER_DEBOUNCE 200
+
+DirWatcher::DirWatcher(QObject *parent, QString path_abs, bool watch_files) :
+    QObject(parent)
+{
+    PLOG(lcFs, 1) << "[DirWatcher::DirWatcher]" << path_abs << watch_files;
+    m_path_abs = path_abs;
+    m_watch_files = watch_files;
+    m_dirChanged = false;
+
+    m_debounce = new QTimer(this);
+    m_debounce->setSingleShot(true);
+    m_debounce->setInterval(DIRWATCHER_DEBOUNCE);
+    connect(m_debounce, &QTimer::timeout, this, &DirWatcher::onDebounced);
+
+    m_watcher = new QFileSystemWatcher(this);
+    connect(m_watcher, &QFileSystemWatcher::directoryChanged, this, &DirWatcher::onDirectoryChanged);
+    connect(m_watcher, &QFileSystemWatcher::fileChanged, this, &DirWatcher::onFileChanged);
+    m_watcher->addPath(m_path_abs);
+
+    m_snapshot = scan();
+    if (m_watch_files) {
+        QStringList files;
+        foreach (QVariantMap entry, m_snapshot) {
+            if (entry.value("type") == "file") files.append(m_path_abs + "/" + entry.value("name").toString());
+        }
+        if (!files.isEmpty()) m_watcher->addPaths(files);
+    }
+}
+
+DirWatcher::~DirWatcher() {
+    PLOG(lcFs, 1) << "[DirWatcher::~DirWatcher]" << m_path_abs;
+}
+
+QVariantMap DirWatcher::entryInfo(const QFileInfo &info) {
+    QVariantMap entry;
+    entry.insert("name", info.fileName());
+    entry.insert("size", info.size());
+    entry.insert("mtime", info.lastModified().toMSecsSinceEpoch());
+    if (info.isSymLink()) {
+        entry.insert("type", "symlink");
+    } else if (info.isDir()) {
+        entry.insert("type", "dir");
+    } else {
+        entry.insert("type", "file");
+    }
+    return entry;
+}
+
+QMap<QString, QVariantMap> DirWatcher::scan() {
+    QMap<QString, QVariantMap> snapshot;
+    QDir d(m_path_abs);
+    d.setFilter(QDir::Files | QDir::Hidden | QDir::Dirs | QDir::NoDotAndDotDot);
+    foreach (QFileInfo info, d.entryInfoList()) {
+        snapshot.insert(info.fileName(), entryInfo(info));
+    }
+    return snapshot;
+}
+
+void DirWatcher::onDirectoryChanged(QString path) {
+    PLOG(lcFs, 3) << "[DirWatcher::onDirectoryChanged]" << path;
+    m_dirChanged = true;
+    // not restarted, so that a file that keeps growing is still reported
+    // every DIRWATCHER_DEBOUNCE ms rather than only after writes stop
+    if (!m_debounce->isActive()) m_debounce->start();
+}
+
+void DirWatcher::onFileChanged(QString path) {
+    PLOG(lcFs, 3) << "[DirWatcher::onFileChanged]" << path;
+    m_changedFiles.insert(QFileInfo(path).fileName());
+    if (!m_debounce->isActive()) m_debounce->start();
+}
+
+/* Emits the differences since the last report as lists "added",
+ * "removed" (names) and "modified". After a directory notification the
+ * whole directory is listed and compared; if only watched files changed,
+ * just those are stat'ed, so a growing download does not cost a listing
+ * of the whole directory every DIRWATCHER_DEBOUNCE ms.
+ */
+void DirWatcher::onDebounced() {
+    QVariantList added;
+    QVariantList modified;
+    QStringList removed;
+
+    if (m_dirChanged) {
+        diffDirectory(added, removed, modified);
+    } else {
+        diffFiles(removed, modified);
+    }
+    m_dirChanged = false;
+    m_changedFiles.clear();
+
+    if (added.isEmpty() && modified.isEmpty() && removed.isEmpty()) return;
+
+    QVariantMap changes;
+    changes.insert("added", added);
+    changes.insert("removed", removed);
+    changes.insert("modified", modified);
+    PLOG(lcFs, 2) << "[DirWatcher::onDebounced]" << m_path_abs << added.length() << removed.length() << modified.length();
+    emit changed(changes);
+}
+
+void DirWatcher::diffFiles(QStringList &removed, QVariantList &modified) {
+    foreach (QString name, m_changedFiles) {
+        if (!m_snapshot.contains(name)) continue;
+        QFileInfo info(m_path_abs + "/" + name);
+        if (!info.exists()) {
+            removed.append(name);
+            m_snapshot.remove(name);
+            continue;
+        }
+        QVariantMap entry = entryInfo(info);
+        if (m_snapshot.value(name) != entry) {
+            modified.append(entry);
+            m_snapshot.insert(name, entry);
+        }
+    }
+}
+
+void DirWatcher::diffDirectory(QVariantList &added, QStringList &removed, QVariantList &modified) {
+    QMap<QString, QVariantMap> snapshot = scan();
+
+    QMapIterator<QString, QVariantMap> it(snapshot);
+    while (it.hasNext()) {
+        it.next();
+        if (!m_snapshot.contains(it.key())) {
+            added.append(it.value());
+            if (m_watch_files && it.value().value("type") == "file") {
+                m_watcher->addPath(m_path_abs + "/" + it.key());
+            }
+        } else if (m_snapshot.value(it.key()) != it.value()) {
+            modified.append(it.value());
+        }
+    }
+    foreach (QString name, m_snapshot.keys()) {
+        if (!snapshot.contains(name)) removed.append(name);
+    }
+    m_snapshot = snapshot;
+}
+
+QVariantList DirWatcher::entries() {
+    QVariantList list;
+    foreach (QVariantMap entry, m_snapshot) {
+        list.append(entry);
+    }
+    return list;
+}
+
+void DirWatcher::stop() {
+    PLOG(lcFs, 1) << "[DirWatcher::stop]" << m_path_abs;
+    m_debounce->stop();
+    QStringList paths = m_watcher->directories() + m_watcher->files();
+    if (!paths.isEmpty()) m_watcher->removePaths(paths);
+}
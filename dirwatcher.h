@@ -0,0 +1,80 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef DIRWATCHER_H
+#define DIRWATCHER_H
+
+#include <QObject>
+#include <QFileSystemWatcher>
+#include <QFileInfo>
+#include <QTimer>
+#include <QMap>
+#include <QSet>
+#include <QVariantMap>
+
+/* Watches one directory (inotify on Linux) and reports what changed since
+ * the last report as a single changed() signal, so a directory view can be
+ * updated incrementally instead of re-listing it. Notifications are
+ * coalesced for DIRWATCHER_DEBOUNCE ms. Only a directory notification
+ * causes a re-listing; a file notification re-reads just that file.
+ *
+ * Directory watches report created, removed and renamed entries. To also
+ * see files growing (e.g. downloads), pass watch_files; this uses one
+ * watch per file, of which the system allows a limited number.
+ */
+class DirWatcher : public QObject
+{
+    Q_OBJECT
+public:
+    explicit DirWatcher(QObject *parent, QString path_abs, bool watch_files = false);
+    ~DirWatcher();
+
+    static QVariantMap entryInfo(const QFileInfo &info);
+
+private:
+    QString m_path_abs;
+    bool m_watch_files;
+    QFileSystemWatcher *m_watcher;
+    QTimer *m_debounce;
+    QMap<QString, QVariantMap> m_snapshot;
+    bool m_dirChanged;
+    QSet<QString> m_changedFiles;
+
+    // methods
+    QMap<QString, QVariantMap> scan();
+    void diffDirectory(QVariantList &added, QStringList &removed, QVariantList &modified);
+    void diffFiles(QStringList &removed, QVariantList &modified);
+
+signals:
+    void changed(QVariantMap changes);
+
+private slots:
+    void onDirectoryChanged(QString path);
+    void onFileChanged(QString path);
+    void onDebounced();
+
+public slots:
+    QVariantList entries();
+    void stop();
+};
+
+#endif // DIRWATCHER_H
@@ -21,11 +21,12 @@
  */
 
 #include "downloader.h"
+#include "logging.h"
 
 Downloader::Downloader(QObject *parent, QNetworkAccessManager * manager, QString id, QString path, QString filename) :
     QObject(parent)
 {
-    qDebug() << "Level0 [Downloader::initialize]" << id << path << filename;
+    PLOG(lcNet, 0) << "[Downloader::initialize]" << id << path << filename;
     m_manager = manager;
     m_id = id;
     m_path = path;
@@ -34,15 +35,15 @@ Downloader::Downloader(QObject *parent, QNetworkAccessManager * manager, QString
 }
 
 Downloader::~Downloader() {
-    qDebug() << "Level0 [Downloader::~Downloader] Called" << m_id;
+    PLOG(lcNet, 0) << "[Downloader::~Downloader] Called" << m_id;
     abort();
     m_reply->deleteLater();
     this->deleteLater();
-    qDebug() << "Level0 [Downloader::~Downloader] Done" << m_id;
+    PLOG(lcNet, 0) << "[Downloader::~Downloader] Done" << m_id;
 }
 
 void Downloader::get() {
-    qDebug() << "Level0 [Downloader::get]" << m_id << QUrl(m_path + "/" + m_filename);
+    PLOG(lcNet, 0) << "[Downloader::get]" << m_id << QUrl(m_path + "/" + m_filename);
     m_reply = m_manager->get(QNetworkRequest(QUrl(m_path + "/" + m_filename)));
     /*
     connect(m_reply, &QNetworkAccessManager::finished, this, &Downloader::replyFinished);
@@ -53,18 +54,18 @@ void Downloader::get() {
 }
 
 void Downloader::abort() {
-    qDebug() << "Level0 [Downloader::abort]" << m_id << m_reply;
+    PLOG(lcNet, 0) << "[Downloader::abort]" << m_id << m_reply;
     if (m_reply) m_reply->abort();
 }
 
 void Downloader::replyProgress(qint64 bytesReceived, qint64 bytesTotal) {
-    qDebug() << "Level3 [Downloader::replyProgress]:"<< m_id << bytesReceived << bytesTotal;
+    PLOG(lcNet, 3) << "[Downloader::replyProgress]:"<< m_id << bytesReceived << bytesTotal;
     emit progress(bytesReceived, bytesTotal);
 }
 
 void Downloader::replyFinished() {
     if( m_reply->error() ) {
-        qDebug() << "Level0 [Downloader::replyFinished] Error:"<< m_id << m_reply->errorString();
+        PLOG(lcNet, 0) << "[Downloader::replyFinished] Error:"<< m_id << m_reply->errorString();
         emit error(m_reply->errorString());
 
     } else {
@@ -79,7 +80,7 @@ void Downloader::replyFinished() {
             m_file->close();
         } else {
             emit error("couldNotOpenFile");
-            qDebug() << "Level0 [Downloader::replyFinished] Error: could not open file" << jail_working_path + "/" + m_filename;
+            PLOG(lcNet, 0) << "[Downloader::replyFinished] Error: could not open file" << jail_working_path + "/" + m_filename;
         }
         emit saved(m_filename);
         m_file->deleteLater();
@@ -0,0 +1,125 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "filehandle.h"
+#include "logging.h"
+
+#include <QDebug>
+#include <string.h>
+
+#define FILEHANDLE_MAP_THRESHOLD 4194304
+
+FileHandle::FileHandle(QString path_abs, bool may_map) :
+    m_file(path_abs)
+{
+    m_may_map = may_map;
+    m_map = NULL;
+    m_size = 0;
+    m_pos = 0;
+}
+
+FileHandle::~FileHandle() {
+    if (m_map) m_file.unmap(m_map);
+    m_file.close();
+}
+
+bool FileHandle::open() {
+    if (!m_file.open(QIODevice::ReadOnly)) return false;
+    m_size = m_file.size();
+    if (m_may_map && m_size >= FILEHANDLE_MAP_THRESHOLD) {
+        m_map = m_file.map(0, m_size);
+        PLOG(lcFs, 2) << "[FileHandle::open] mapped" << m_file.fileName() << (m_map != NULL);
+    }
+    return true;
+}
+
+qint64 FileHandle::size() {
+    return m_size;
+}
+
+qint64 FileHandle::pos() {
+    return m_pos;
+}
+
+bool FileHandle::seek(qint64 pos) {
+    if (pos < 0 || pos > m_size) return false;
+    m_pos = pos;
+    return true;
+}
+
+QByteArray FileHandle::read(qint64 pos, qint64 length) {
+    if (pos < 0 || pos >= m_size || length <= 0) return QByteArray();
+    length = qMin(length, m_size - pos);
+    if (m_map) {
+        return QByteArray((const char *)m_map + pos, length);
+    }
+    if (!m_file.seek(pos)) return QByteArray();
+    return m_file.read(length);
+}
+
+/* Returns up to count lines from the current position, without line
+ * terminators, and advances the position. Lines longer than max_length
+ * bytes (e.g. in binary files without any '\n') are cut at max_length,
+ * the rest of the line is skipped, and the index of the line is added to
+ * truncated. done is set when the end of the file is reached.
+ */
+QStringList FileHandle::readLines(int count, qint64 max_length, bool *done, QList<int> *truncated) {
+    QStringList lines;
+    *done = false;
+
+    if (m_map) {
+        const char *data = (const char *)m_map;
+        while (lines.length() < count && m_pos < m_size) {
+            const char *start = data + m_pos;
+            const char *newline = (const char *)memchr(start, '\n', m_size - m_pos);
+            qint64 length = newline ? newline - start : m_size - m_pos;
+            qint64 line_length = length;
+            if (line_length > max_length) {
+                line_length = max_length;
+                truncated->append(lines.length());
+            } else if (line_length > 0 && start[line_length - 1] == '\r') {
+                line_length--;
+            }
+            lines.append(QString::fromUtf8(start, (int)line_length));
+            m_pos += newline ? length + 1 : length;
+        }
+    } else {
+        m_file.seek(m_pos);
+        while (lines.length() < count && !m_file.atEnd()) {
+            QByteArray line = m_file.readLine(max_length + 1);
+            if (line.endsWith('\n')) {
+                line.chop(1);
+                if (line.endsWith('\r')) line.chop(1);
+            } else if (line.length() > max_length) {
+                line.truncate(max_length);
+                truncated->append(lines.length());
+                // skip the rest of the line without keeping it
+                while (!m_file.atEnd() && !m_file.readLine(65536).endsWith('\n')) {}
+            }
+            lines.append(QString::fromUtf8(line));
+        }
+        m_pos = m_file.pos();
+    }
+
+    *done = m_pos >= m_size;
+    return lines;
+}
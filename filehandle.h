@@ -0,0 +1,57 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef FILEHANDLE_H
+#define FILEHANDLE_H
+
+#include <QFile>
+#include <QList>
+#include <QStringList>
+
+/* An open file for ranged and line-by-line reading without loading the
+ * whole file. With may_map, files of FILEHANDLE_MAP_THRESHOLD bytes and
+ * more are memory mapped; other files are read with seek() and read().
+ * Only pass may_map for files nothing truncates while they are open:
+ * touching a mapped page beyond the new end of file raises SIGBUS.
+ */
+class FileHandle
+{
+public:
+    explicit FileHandle(QString path_abs, bool may_map = false);
+    ~FileHandle();
+
+    bool open();
+    qint64 size();
+    qint64 pos();
+    bool seek(qint64 pos);
+    QByteArray read(qint64 pos, qint64 length);
+    QStringList readLines(int count, qint64 max_length, bool *done, QList<int> *truncated);
+
+private:
+    QFile m_file;
+    bool m_may_map;
+    uchar *m_map;
+    qint64 m_size;
+    qint64 m_pos;
+};
+
+#endif // FILEHANDLE_H
@@ -0,0 +1,269 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "fileopjob.h"
+#include "logging.h"
+#include "fileutil.h"
+#include "contentstore.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDirIterator>
+#include <QDebug>
+
+#define FILEOPJOB_PROGRESS_INTERVAL 250
+#define FILEOPJOB_CHUNK 1048576
+
+FileOpJob::FileOpJob(qint64 id, Type type, QString src_abs, QString dst_abs, QByteArray content, int open_mode) :
+    QObject(0)
+{
+    m_id = id;
+    m_type = type;
+    m_src_abs = src_abs;
+    m_dst_abs = dst_abs;
+    m_content = content;
+    m_open_mode = open_mode;
+    m_hashtype = 1;
+    m_tree = false;
+    m_cancelled = 0;
+    m_lastProgress = 0;
+    setAutoDelete(false);
+}
+
+FileOpJob::~FileOpJob() {
+    PLOG(lcFs, 2) << "[FileOpJob::~FileOpJob]" << m_id;
+}
+
+/* For StoreImport: the key the file is to be stored under, and how to
+ * verify it.
+ */
+void FileOpJob::setStoreHash(QString hash, int hashtype, bool tree) {
+    m_hash = hash;
+    m_hashtype = hashtype;
+    m_tree = tree;
+}
+
+void FileOpJob::cancel() {
+    m_cancelled = 1;
+}
+
+QVariantMap FileOpJob::error(QString info) {
+    QVariantMap map;
+    map.insert("status", "Error");
+    map.insert("info", info);
+    return map;
+}
+
+void FileOpJob::reportProgress(qint64 done, qint64 total) {
+    qint64 now = m_timer.elapsed();
+    if (now - m_lastProgress < FILEOPJOB_PROGRESS_INTERVAL) return;
+    m_lastProgress = now;
+    emit progress(m_id, done, total);
+}
+
+void FileOpJob::run() {
+    PLOG(lcFs, 2) << "[FileOpJob::run]" << m_id << m_type << m_src_abs << m_dst_abs;
+    QVariantMap map;
+    m_timer.start();
+
+    if (m_cancelled.load()) {
+        map = error("cancelled");
+    } else if (m_type == Copy) {
+        map = runCopy();
+    } else if (m_type == Rename) {
+        map = runRename();
+    } else if (m_type == RemoveDir) {
+        map = runRemoveDir();
+    } else if (m_type == StoreImport) {
+        map = runStoreImport();
+    } else {
+        map = runWrite();
+    }
+    map.insert("ms", m_timer.elapsed());
+    emit finished(m_id, map);
+}
+
+/* Like QFile::copy, fails if the destination exists. Tries a reflink
+ * first, which is instant on copy-on-write file systems.
+ */
+QVariantMap FileOpJob::runCopy() {
+    QFile src(m_src_abs);
+    if (!src.exists()) return error("fileNotExisting");
+    if (QFile::exists(m_dst_abs)) return error("destinationExisting");
+
+    qint64 total = src.size();
+    QString part_abs = m_dst_abs + ".part";
+    QFile::remove(part_abs);
+
+    if (!FileUtil::reflink(m_src_abs, part_abs)) {
+        QFile::remove(part_abs);
+        if (!src.open(QIODevice::ReadOnly)) return error("fileCannotOpen");
+        QFile dst(part_abs);
+        if (!dst.open(QIODevice::WriteOnly)) return error("destinationCannotOpen");
+
+        QByteArray buf;
+        buf.resize(FILEOPJOB_CHUNK);
+        qint64 done = 0;
+        while (true) {
+            if (m_cancelled.load()) {
+                dst.close();
+                dst.remove();
+                return error("cancelled");
+            }
+            qint64 read_bytes = src.read(buf.data(), FILEOPJOB_CHUNK);
+            if (read_bytes < 0) {
+                dst.close();
+                dst.remove();
+                return error("fileCannotRead");
+            }
+            if (read_bytes == 0) break;
+            if (dst.write(buf.constData(), read_bytes) != read_bytes) {
+                dst.close();
+                dst.remove();
+                return error("destinationCannotWrite");
+            }
+            done += read_bytes;
+            reportProgress(done, total);
+        }
+        dst.close();
+        src.close();
+    }
+
+    if (!QFile::rename(part_abs, m_dst_abs)) {
+        QFile::remove(part_abs);
+        return error("destinationCannotRename");
+    }
+
+    QVariantMap map;
+    map.insert("status", "OK");
+    map.insert("size", total);
+    return map;
+}
+
+/* Across file systems QFile::rename falls back to copy and remove, which
+ * is the slow case this job exists for. It cannot be cancelled.
+ */
+QVariantMap FileOpJob::runRename() {
+    if (!QFile::exists(m_src_abs)) return error("fileNotExisting");
+    if (!QFile::rename(m_src_abs, m_dst_abs)) return error("cannotRename");
+    QVariantMap map;
+    map.insert("status", "OK");
+    return map;
+}
+
+/* Deletes files first and then the directories, deepest first. Progress
+ * counts removed entries. On cancellation, what was already removed
+ * stays removed.
+ */
+QVariantMap FileOpJob::runRemoveDir() {
+    QDir dir(m_src_abs);
+    if (!dir.exists()) return error("dirNotExisting");
+
+    QStringList files;
+    QStringList dirs;
+    QDirIterator it(m_src_abs, QDir::Files | QDir::Hidden | QDir::System | QDir::Dirs | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        it.next();
+        QFileInfo info = it.fileInfo();
+        if (info.isDir() && !info.isSymLink()) {
+            dirs.append(info.filePath());
+        } else {
+            files.append(info.filePath());
+        }
+        if (m_cancelled.load()) return error("cancelled");
+    }
+    // QDirIterator lists parents before children
+    dirs.append(m_src_abs);
+
+    qint64 total = files.length() + dirs.length();
+    qint64 done = 0;
+    foreach (QString path, files) {
+        if (m_cancelled.load()) return error("cancelled");
+        if (!QFile::remove(path)) return error("cannotRemove");
+        done++;
+        reportProgress(done, total);
+    }
+    for (int i = dirs.length() - 1; i >= 0; i--) {
+        if (m_cancelled.load()) return error("cancelled");
+        if (!QDir().rmdir(dirs.at(i))) return error("cannotRemove");
+        done++;
+        reportProgress(done, total);
+    }
+
+    QVariantMap map;
+    map.insert("status", "OK");
+    map.insert("removed", done);
+    return map;
+}
+
+/* Only a plain WriteOnly replaces the file via a temporary file. Append
+ * and ReadWrite keep existing contents and therefore write in place.
+ */
+QVariantMap FileOpJob::runWrite() {
+    bool replace = !(m_open_mode & (QIODevice::Append | QIODevice::ReadOnly));
+    QString path_abs = replace ? m_dst_abs + ".part" : m_dst_abs;
+
+    QFile f(path_abs);
+    if (!f.open((QIODevice::OpenMode)m_open_mode)) return error("fileCannotOpen");
+
+    qint64 total = m_content.length();
+    qint64 done = 0;
+    while (done < total) {
+        if (m_cancelled.load()) {
+            f.close();
+            if (replace) f.remove();
+            return error("cancelled");
+        }
+        qint64 written_bytes = f.write(m_content.constData() + done, qMin((qint64)FILEOPJOB_CHUNK, total - done));
+        if (written_bytes <= 0) {
+            f.close();
+            if (replace) f.remove();
+            return error("fileCannotWrite");
+        }
+        done += written_bytes;
+        reportProgress(done, total);
+    }
+    f.close();
+
+    if (replace) {
+        QFile::remove(m_dst_abs);
+        if (!QFile::rename(path_abs, m_dst_abs)) {
+            QFile::remove(path_abs);
+            return error("cannotRename");
+        }
+    }
+
+    QVariantMap map;
+    map.insert("status", "OK");
+    map.insert("size", done);
+    return map;
+}
+
+QVariantMap FileOpJob::runStoreImport() {
+    QString info;
+    if (!ContentStore::import(m_src_abs, m_hash, m_hashtype, m_tree, &info)) return error(info);
+    QVariantMap map;
+    map.insert("status", "OK");
+    map.insert("hash", m_hash);
+    return map;
+}
@@ -0,0 +1,83 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef FILEOPJOB_H
+#define FILEOPJOB_H
+
+#include <QObject>
+#include <QRunnable>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QVariantMap>
+
+/* One file operation that runs on the file operation QThreadPool of JsApi,
+ * so that large copies or deletions do not block the GUI thread and the
+ * sockets it serves. Progress is reported at most every
+ * FILEOPJOB_PROGRESS_INTERVAL ms, the outcome with finished(). A job
+ * cancelled while still queued finishes as soon as it is started.
+ *
+ * Copies and writes go to a temporary file next to the destination which
+ * is renamed when complete, so an interrupted operation never leaves a
+ * truncated destination behind.
+ */
+class FileOpJob : public QObject, public QRunnable
+{
+    Q_OBJECT
+public:
+    enum Type { Copy, Rename, RemoveDir, Write, StoreImport };
+
+    explicit FileOpJob(qint64 id, Type type, QString src_abs, QString dst_abs = "", QByteArray content = QByteArray(), int open_mode = 2);
+    ~FileOpJob();
+
+    void setStoreHash(QString hash, int hashtype, bool tree);
+    void run();
+    void cancel();
+
+private:
+    qint64 m_id;
+    Type m_type;
+    QString m_src_abs;
+    QString m_dst_abs;
+    QByteArray m_content;
+    int m_open_mode;
+    QString m_hash;
+    int m_hashtype;
+    bool m_tree;
+    QAtomicInt m_cancelled;
+    QElapsedTimer m_timer;
+    qint64 m_lastProgress;
+
+    // methods
+    QVariantMap runCopy();
+    QVariantMap runRename();
+    QVariantMap runRemoveDir();
+    QVariantMap runWrite();
+    QVariantMap runStoreImport();
+    void reportProgress(qint64 done, qint64 total);
+    QVariantMap error(QString info);
+
+signals:
+    void progress(qint64 id, qint64 done, qint64 total);
+    void finished(qint64 id, QVariantMap result);
+};
+
+#endif // FILEOPJOB_H
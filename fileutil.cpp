@@ -0,0 +1,132 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "fileutil.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDebug>
+
+#ifdef Q_OS_WIN
+    #include <windows.h>
+#else
+    #include <unistd.h>
+    #include <fcntl.h>
+#endif
+
+#ifdef Q_OS_LINUX
+    #include <sys/ioctl.h>
+    #include <sys/stat.h>
+    #include <linux/fs.h>
+    #include <errno.h>
+    #if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+        #define HAVE_COPY_FILE_RANGE
+    #endif
+#endif
+
+#if !defined(Q_OS_WIN) && QT_VERSION < 0x050A00
+    #include <utime.h>
+#endif
+
+/* Creates dst as a copy-on-write clone of src (Btrfs, XFS, ...). The
+ * clone shares data blocks with src but is an independent file. Fails
+ * on file systems or platforms without reflink support.
+ */
+bool FileUtil::reflink(QString src_abs, QString dst_abs) {
+#if defined(Q_OS_LINUX) && defined(FICLONE)
+    int src_fd = ::open(QFile::encodeName(src_abs).constData(), O_RDONLY);
+    if (src_fd < 0) return false;
+    int dst_fd = ::open(QFile::encodeName(dst_abs).constData(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (dst_fd < 0) {
+        ::close(src_fd);
+        return false;
+    }
+    bool success = ::ioctl(dst_fd, FICLONE, src_fd) == 0;
+    ::close(dst_fd);
+    ::close(src_fd);
+    if (!success) QFile::remove(dst_abs);
+    return success;
+#else
+    Q_UNUSED(src_abs);
+    Q_UNUSED(dst_abs);
+    return false;
+#endif
+}
+
+/* Copies src to a new file dst. Tries a reflink first, then an in-kernel
+ * copy with copy_file_range on Linux (no copying through user space, and
+ * server-side copies on NFS/CIFS), then QFile::copy.
+ */
+bool FileUtil::copyFile(QString src_abs, QString dst_abs) {
+    if (reflink(src_abs, dst_abs)) return true;
+
+#ifdef HAVE_COPY_FILE_RANGE
+    int src_fd = ::open(QFile::encodeName(src_abs).constData(), O_RDONLY);
+    if (src_fd >= 0) {
+        struct stat st;
+        int dst_fd = -1;
+        if (::fstat(src_fd, &st) == 0) {
+            dst_fd = ::open(QFile::encodeName(dst_abs).constData(), O_WRONLY | O_CREAT | O_EXCL, st.st_mode & 0777);
+        }
+        if (dst_fd >= 0) {
+            off_t remaining = st.st_size;
+            bool supported = true;
+            while (remaining > 0) {
+                ssize_t copied = ::copy_file_range(src_fd, NULL, dst_fd, NULL, remaining, 0);
+                if (copied <= 0) {
+                    supported = false;
+                    break;
+                }
+                remaining -= copied;
+            }
+            ::close(dst_fd);
+            ::close(src_fd);
+            if (supported) return true;
+            // e.g. EXDEV on older kernels: fall back to a regular copy
+            QFile::remove(dst_abs);
+        } else {
+            ::close(src_fd);
+        }
+    }
+#endif
+
+    return QFile::copy(src_abs, dst_abs);
+}
+
+bool FileUtil::setModificationTime(QString path_abs, QDateTime mtime) {
+#if QT_VERSION >= 0x050A00
+    QFile f(path_abs);
+    if (!f.open(QIODevice::ReadWrite)) return false;
+    bool success = f.setFileTime(mtime, QFileDevice::FileModificationTime);
+    f.close();
+    return success;
+#elif !defined(Q_OS_WIN)
+    struct utimbuf times;
+    times.actime = mtime.toTime_t();
+    times.modtime = mtime.toTime_t();
+    return ::utime(QFile::encodeName(path_abs).constData(), &times) == 0;
+#else
+    Q_UNUSED(path_abs);
+    Q_UNUSED(mtime);
+    return false;
+#endif
+}
@@ -0,0 +1,254 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "hashjob.h"
+#include "logging.h"
+#include "xxhash64.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QCryptographicHash>
+#include <QtEndian>
+#include <QtConcurrent>
+#include <QDebug>
+
+#define HASHJOB_PROGRESS_INTERVAL 250
+#define HASHJOB_TREE_CHUNK 4194304
+
+/* Common interface over QCryptographicHash and the additional checksums.
+ */
+class Hasher
+{
+public:
+    explicit Hasher(int type) : m_type(type), m_crypto(NULL) {
+        if (m_type != HashJob::XxHash64Type) {
+            m_crypto = new QCryptographicHash((QCryptographicHash::Algorithm)m_type);
+        }
+    }
+    ~Hasher() {
+        delete m_crypto;
+    }
+    void addData(const char *data, qint64 length) {
+        if (m_crypto) {
+            m_crypto->addData(data, length);
+        } else {
+            m_xxhash.addData(data, length);
+        }
+    }
+    QByteArray result() {
+        if (m_crypto) return m_crypto->result();
+        QByteArray digest(8, 0);
+        qToBigEndian<quint64>(m_xxhash.digest(), (uchar *)digest.data());
+        return digest;
+    }
+
+private:
+    int m_type;
+    QCryptographicHash *m_crypto;
+    XxHash64 m_xxhash;
+};
+
+/* Map functor for QtConcurrent, which needs result_type on older Qt 5.
+ */
+struct HashChunkFunctor
+{
+    typedef QByteArray result_type;
+    HashJob *m_job;
+    explicit HashChunkFunctor(HashJob *job) : m_job(job) {}
+    QByteArray operator()(qint64 offset) { return m_job->hashChunk(offset); }
+};
+
+HashJob::HashJob(qint64 id, QString path, int type, bool tree, qint64 chunksize) :
+    QObject(0)
+{
+    m_id = id;
+    m_path = path;
+    m_type = type;
+    m_tree = tree;
+    m_chunksize = chunksize;
+    m_total = 0;
+    m_cancelled = 0;
+    m_done = 0;
+    m_lastProgress = 0;
+    setAutoDelete(false);
+}
+
+HashJob::~HashJob() {
+    PLOG(lcFs, 2) << "[HashJob::~HashJob]" << m_id;
+}
+
+bool HashJob::isValidType(int type) {
+    return type == XxHash64Type || (type >= 0 && type <= QCryptographicHash::Sha3_512);
+}
+
+QByteArray HashJob::hashData(int type, const char *data, qint64 length) {
+    Hasher hasher(type);
+    hasher.addData(data, length);
+    return hasher.result();
+}
+
+/* Hashes a file in the calling thread (tree mode still uses all cores)
+ * and returns the hex digest, or an empty string on error.
+ */
+QString HashJob::hashFile(QString path, int type, bool tree) {
+    if (!isValidType(type) || !QFile::exists(path)) return "";
+    HashJob job(0, path, type, tree);
+    job.m_total = QFileInfo(path).size();
+    job.m_timer.start();
+    QVariantMap map = tree ? job.runTree() : job.runSequential();
+    if (map.value("status").toString() != "OK") return "";
+    return map.value("result").toString();
+}
+
+void HashJob::cancel() {
+    m_cancelled = 1;
+}
+
+/* Called from any thread. Only the caller that wins the compare-and-swap
+ * on the last report time emits, so reports stay throttled in tree mode.
+ */
+void HashJob::reportProgress(qint64 bytes) {
+    qint64 done = m_done.fetchAndAddOrdered(bytes) + bytes;
+    qint64 now = m_timer.elapsed();
+    qint64 last = m_lastProgress.load();
+    if (now - last >= HASHJOB_PROGRESS_INTERVAL && m_lastProgress.testAndSetOrdered(last, now)) {
+        emit progress(m_id, done, m_total);
+    }
+}
+
+void HashJob::run() {
+    PLOG(lcFs, 2) << "[HashJob::run]" << m_id << m_path << m_type << m_tree;
+    QVariantMap map;
+
+    QFile file(m_path);
+    if (!file.exists()) {
+        map.insert("status", "Error");
+        map.insert("info", "fileNotExisting");
+        emit finished(m_id, map);
+        return;
+    }
+    m_total = file.size();
+    m_timer.start();
+
+    map = m_tree ? runTree() : runSequential();
+    emit finished(m_id, map);
+}
+
+QVariantMap HashJob::runSequential() {
+    QVariantMap map;
+
+    QFile file(m_path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        map.insert("status", "Error");
+        map.insert("info", "fileCannotOpen");
+        return map;
+    }
+
+    Hasher hasher(m_type);
+    QByteArray buf;
+    buf.resize(m_chunksize);
+    qint64 done = 0;
+
+    while (true) {
+        if (m_cancelled.load()) {
+            map.insert("status", "Error");
+            map.insert("info", "cancelled");
+            return map;
+        }
+        qint64 read_bytes = file.read(buf.data(), m_chunksize);
+        if (read_bytes < 0) {
+            map.insert("status", "Error");
+            map.insert("info", "fileCannotRead");
+            return map;
+        }
+        if (read_bytes == 0) break;
+        hasher.addData(buf.constData(), read_bytes);
+        done += read_bytes;
+        reportProgress(read_bytes);
+    }
+    file.close();
+
+    map.insert("status", "OK");
+    map.insert("size", done);
+    map.insert("result", QString(hasher.result().toHex()));
+    return map;
+}
+
+/* Returns the digest of one chunk, or an empty QByteArray on error or
+ * cancellation. Each call opens its own file handle, so chunks can be
+ * read concurrently.
+ */
+QByteArray HashJob::hashChunk(qint64 offset) {
+    if (m_cancelled.load()) return QByteArray();
+
+    QFile file(m_path);
+    if (!file.open(QIODevice::ReadOnly) || !file.seek(offset)) return QByteArray();
+
+    Hasher hasher(m_type);
+    QByteArray buf;
+    buf.resize(qMin(m_chunksize, (qint64)HASHJOB_TREE_CHUNK));
+    qint64 remaining = qMin((qint64)HASHJOB_TREE_CHUNK, m_total - offset);
+    while (remaining > 0) {
+        if (m_cancelled.load()) return QByteArray();
+        qint64 read_bytes = file.read(buf.data(), qMin(remaining, (qint64)buf.size()));
+        if (read_bytes <= 0) return QByteArray();
+        hasher.addData(buf.constData(), read_bytes);
+        remaining -= read_bytes;
+        reportProgress(read_bytes);
+    }
+    return hasher.result();
+}
+
+QVariantMap HashJob::runTree() {
+    QVariantMap map;
+
+    QList<qint64> offsets;
+    for (qint64 offset = 0; offset < m_total || offsets.isEmpty(); offset += HASHJOB_TREE_CHUNK) {
+        offsets.append(offset);
+    }
+
+    // the calling pool thread takes part in the work, so this cannot
+    // starve the pool
+    QList<QByteArray> digests = QtConcurrent::blockingMapped<QList<QByteArray> >(offsets, HashChunkFunctor(this));
+
+    if (m_cancelled.load()) {
+        map.insert("status", "Error");
+        map.insert("info", "cancelled");
+        return map;
+    }
+
+    Hasher root(m_type);
+    foreach (QByteArray digest, digests) {
+        if (digest.isEmpty() && m_total > 0) {
+            map.insert("status", "Error");
+            map.insert("info", "fileCannotRead");
+            return map;
+        }
+        root.addData(digest.constData(), digest.length());
+    }
+
+    map.insert("status", "OK");
+    map.insert("size", m_total);
+    map.insert("tree_chunk_size", HASHJOB_TREE_CHUNK);
+    map.insert("result", QString(root.result().toHex()));
+    return map;
+}
@@ -0,0 +1,83 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef HASHJOB_H
+#define HASHJOB_H
+
+#include <QObject>
+#include <QRunnable>
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QVariantMap>
+
+/* Hashes one file on a QThreadPool thread. Progress is reported at most
+ * every HASHJOB_PROGRESS_INTERVAL ms, the digest with finished().
+ *
+ * type is a QCryptographicHash::Algorithm or one of the additional fast
+ * checksums below. In tree mode the file is cut into HASHJOB_TREE_CHUNK
+ * sized chunks which are hashed in parallel on all cores; the result is
+ * the hash of the concatenated chunk digests. Tree digests differ from
+ * plain digests, so both ends of a transfer must use the same mode.
+ */
+class HashJob : public QObject, public QRunnable
+{
+    Q_OBJECT
+public:
+    enum { XxHash64Type = 100 };
+
+    explicit HashJob(qint64 id, QString path, int type, bool tree = false, qint64 chunksize = 1048576);
+    ~HashJob();
+
+    static bool isValidType(int type);
+    static QByteArray hashData(int type, const char *data, qint64 length);
+    static QString hashFile(QString path, int type, bool tree = false);
+
+    void run();
+    void cancel();
+
+private:
+    qint64 m_id;
+    QString m_path;
+    int m_type;
+    bool m_tree;
+    qint64 m_chunksize;
+    qint64 m_total;
+    QAtomicInt m_cancelled;
+    QAtomicInteger<qint64> m_done;
+    QAtomicInteger<qint64> m_lastProgress;
+    QElapsedTimer m_timer;
+
+    // methods
+    QVariantMap runSequential();
+    QVariantMap runTree();
+    QByteArray hashChunk(qint64 offset);
+    void reportProgress(qint64 bytes);
+
+    friend struct HashChunkFunctor;
+
+signals:
+    void progress(qint64 id, qint64 bytes, qint64 total);
+    void finished(qint64 id, QVariantMap result);
+};
+
+#endif // HASHJOB_H
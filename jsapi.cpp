@@ -21,6 +21,9 @@
  */
 
 #include "jsapi.h"
+#include "logging.h"
+#include "settingsbuffer.h"
+#include "startuptrace.h"
 #include <QWebFrame>
 #include <QCryptographicHash>
 #include <QSysInfo>
@@ -28,12 +31,22 @@
 #include <QHostInfo>
 #include <QNetworkInterface>
 #include <QMessageBox>
-#include <QDataStream>
+#include <QElapsedTimer>
+#include <QThreadPool>
 
 JsApi::JsApi(MainWindow *parent) :
     QObject(parent)
 {
     m_mainWindow = parent;
+    m_hashJobID = 0;
+    m_fileHandleID = 0;
+    m_fileOpID = 0;
+
+    // own pool, so that long copies do not starve hash jobs and queries
+    m_fileOpPool = new QThreadPool(this);
+    m_fileOpPool->setMaxThreadCount(2);
+
+    m_batchObjects.insert("API", this);
 
 #ifdef Q_OS_MAC
     QShortcut *showOptionsShortcut = new QShortcut(QKeySequence(Qt::ControlModifier + Qt::Key_O), m_mainWindow);
@@ -113,11 +126,11 @@ double JsApi::getMemUsage() {
 
 void JsApi::restart() {
     if (m_mainWindow->windowState().testFlag(Qt::WindowMinimized) == true) {
-        settings->setValue("minified_state", "true");
+        settings_buffer->setValue("minified_state", "true");
     } else {
-        settings->setValue("minified_state", "false");
+        settings_buffer->setValue("minified_state", "false");
     }
-    settings->sync();
+    settings_buffer->sync();
 
     QProcess proc;
     QStringList used_args = QApplication::arguments();
@@ -127,54 +140,73 @@ void JsApi::restart() {
 }
 
 void JsApi::shutdown() {
-    qDebug() << "Level1 [JsApi::shutdown] Called";
+    PLOG(lcJs, 1) << "[JsApi::shutdown] Called";
     if (m_mainWindow->windowState().testFlag(Qt::WindowMinimized) == true) {
-        settings->setValue("minified_state", "true");
+        settings_buffer->setValue("minified_state", "true");
     } else {
-        settings->setValue("minified_state", "false");
+        settings_buffer->setValue("minified_state", "false");
     }
+    settings_buffer->sync();
     qApp->exit(0);
 }
 
 QObject *JsApi::createDatabase(QString label) {
+    // the label becomes a window object and must not replace window.API
+    if (label == "API") return (QObject *)NULL;
     Database *db = new Database(label, this);
     m_mainWindow->webView->page()->mainFrame()->addToJavaScriptWindowObject(label, db, QWebFrame::AutoOwnership);
+    batchAdd(label, db, true);
     return db;
 }
 
+/* Runs Database::benchmark once per performance profile against scratch
+ * files in the working directory, so profiles can be compared on the
+ * user's actual disk.
+ */
+QVariantMap JsApi::benchmarkDatabase(int rows) {
+    QVariantMap result;
+    foreach (QString profile, Database::profiles()) {
+        QString dbpath = jail_working_path + "benchmark_" + profile + ".sqlite";
+        QFile::remove(dbpath);
+        result.insert(profile, Database::benchmark(dbpath, profile, rows));
+        PLOG(lcDb, 1) << "[JsApi::benchmarkDatabase]" << profile << result.value(profile);
+    }
+    return result;
+}
+
+QObject *JsApi::createRetention(QObject *database, QVariantMap config) {
+    Database *db = qobject_cast<Database *>(database);
+    if (!db) return (QObject *)NULL;
+    Retention *r = new Retention(this, db, config);
+    return r;
+}
+
 QObject *JsApi::createDownloader(QString label, QString path, QString filename) {
     Downloader *dl = new Downloader(this, m_mainWindow->m_network_manager, label, path, filename);
     return dl;
 }
 
+/* Returns an Unzipper. Like the ProcessManager it replaces, extraction
+ * starts with run(), emits started() and error(), and ends with
+ * finished(info) including "stdout" and "stderr"; progress() and cancel()
+ * are new. detach is ignored, extraction always runs in the background.
+ */
 QObject *JsApi::runUnzip(QString zip_filepath_rel, QString extract_dir_rel, bool detach) {
-    qDebug() << "Level1 [JsApi::runUnzip]" << zip_filepath_rel << extract_dir_rel << detach;
-
-#ifdef Q_OS_WIN
-    QString unzip_binary_name = application_path + "/unzip.exe";
-    if (!QFile(unzip_binary_name).exists()) return (QObject *)NULL;
-#else
-    QString unzip_binary_name = "unzip";
-#endif
+    PLOG(lcFs, 1) << "[JsApi::runUnzip]" << zip_filepath_rel << extract_dir_rel << detach;
 
+    if (zip_filepath_rel.contains("..")) return (QObject *)NULL;
     if (extract_dir_rel.contains("..")) return (QObject *)NULL;
 
     QString zip_filepath_abs = jail_working_path + "/" + zip_filepath_rel;
     QString destdir_abs = jail_working_path + "/" + extract_dir_rel;
 
-    QStringList args;
-    args.append("-o"); // overwrite
-    args.append(zip_filepath_abs);
-    args.append("-d"); // extractdir
-    args.append(destdir_abs);
-
-    ProcessManager * p = new ProcessManager(this, unzip_binary_name, args, detach);
-    return p;
+    Unzipper *u = new Unzipper(this, zip_filepath_abs, destdir_abs);
+    return u;
 }
 
 #ifdef Q_OS_WIN
 QObject *JsApi::runUpgrader(bool detach) {
-    qDebug() << "Level1 [JsApi::runUpgrader]" << detach;
+    PLOG(lcJs, 1) << "[JsApi::runUpgrader]" << detach;
 
     QStringList args;
     args.append(jail_working_path + "/newbinary");
@@ -185,32 +217,76 @@ QObject *JsApi::runUpgrader(bool detach) {
 }
 #endif
 
-QByteArray JsApi::mapToByteArray(QVariantMap map) {
-    QByteArray ba = QByteArray();
-    QDataStream stream(&ba, QIODevice::WriteOnly);
-    stream << map;
-    return ba;
+/* format is "qdatastream" or "cbor"; when empty, the setting wire_format
+ * decides. Decoding detects the format by itself.
+ */
+QByteArray JsApi::mapToByteArray(QVariantMap map, QString format) {
+    if (format == "") format = settings_buffer->value("wire_format").toString();
+    Codec::encode(map, Codec::formatFromString(format), m_codecBuffer);
+    return m_codecBuffer;
 }
 
 QVariantMap JsApi::byteArrayToMap(QByteArray ba) {
-    QDataStream stream(&ba, QIODevice::ReadOnly);
-    QVariantMap map;
-    stream >> map;
-    return map;
+    return Codec::decode(ba);
 }
 
-QString JsApi::mapToHex(QVariantMap map) {
-    return mapToByteArray(map).toHex();
+QString JsApi::mapToHex(QVariantMap map, QString format) {
+    if (format == "") format = settings_buffer->value("wire_format").toString();
+    Codec::encode(map, Codec::formatFromString(format), m_codecBuffer);
+    return QString::fromLatin1(m_codecBuffer.toHex());
 }
 
 QVariantMap JsApi::hexToMap(QString hex) {
     QByteArray ba = QByteArray::fromHex(hex.toLatin1());
-    return byteArrayToMap(ba);
+    return Codec::decode(ba);
+}
+
+/* Encodes and decodes sample iterations times in every format and
+ * returns the message size and the mean time per operation in
+ * microseconds, with and without the hex step.
+ */
+QVariantMap JsApi::benchmarkCodec(QVariantMap sample, int iterations) {
+    QVariantMap result;
+    if (iterations < 1) iterations = 1;
+    QStringList formats;
+    formats << "qdatastream" << "cbor";
+    foreach (QString format, formats) {
+        Codec::Format f = Codec::formatFromString(format);
+        QByteArray buf;
+        QElapsedTimer timer;
+        QVariantMap stats;
+
+        timer.start();
+        for (int i = 0; i < iterations; i++) Codec::encode(sample, f, buf);
+        stats.insert("encode_us", timer.nsecsElapsed() / 1000.0 / iterations);
+
+        timer.restart();
+        for (int i = 0; i < iterations; i++) Codec::decode(buf);
+        stats.insert("decode_us", timer.nsecsElapsed() / 1000.0 / iterations);
+
+        QString hex;
+        timer.restart();
+        for (int i = 0; i < iterations; i++) {
+            Codec::encode(sample, f, buf);
+            hex = QString::fromLatin1(buf.toHex());
+        }
+        stats.insert("encode_hex_us", timer.nsecsElapsed() / 1000.0 / iterations);
+
+        timer.restart();
+        for (int i = 0; i < iterations; i++) Codec::decode(QByteArray::fromHex(hex.toLatin1()));
+        stats.insert("decode_hex_us", timer.nsecsElapsed() / 1000.0 / iterations);
+
+        stats.insert("bytes", buf.length());
+        stats.insert("roundtrip", Codec::decode(buf) == sample);
+        result.insert(format, stats);
+        PLOG(lcJs, 1) << "[JsApi::benchmarkCodec]" << format << stats;
+    }
+    return result;
 }
 
 void JsApi::showOptionsDialog() {
-    m_mainWindow->optionsDialog->loadSettings();
-    m_mainWindow->optionsDialog->show();
+    m_mainWindow->optionsDialog()->loadSettings();
+    m_mainWindow->optionsDialog()->show();
 }
 
 void JsApi::onOptionsDialogAccepted() {
@@ -222,23 +298,23 @@ void JsApi::onTrayMessageClicked() {
 }
 
 void JsApi::onTrayIconActivated(QSystemTrayIcon::ActivationReason reason) {
-    qDebug() << "Level1 [JsApi::onTrayIconActivated]" << reason;
+    PLOG(lcJs, 1) << "[JsApi::onTrayIconActivated]" << reason;
     emit trayIconActivated(reason);
 }
 
 void JsApi::showTrayMessage(QString title, QString msg, int type, int delay) {
-    qDebug() << "Level1 [JsApi::showTrayMessage]" << title << msg;
+    PLOG(lcJs, 1) << "[JsApi::showTrayMessage]" << title << msg;
     QSystemTrayIcon::MessageIcon sti = (QSystemTrayIcon::MessageIcon)type;
-    m_mainWindow->m_trayIcon->showMessage(title, msg, sti, delay);
+    m_mainWindow->trayIcon()->showMessage(title, msg, sti, delay);
 }
 
 void JsApi::setTrayToolTip(QString tip) {
-    qDebug() << "Level1 [JsApi::setTrayToolTip]";
-    m_mainWindow->m_trayIcon->setToolTip(tip);
+    PLOG(lcJs, 1) << "[JsApi::setTrayToolTip]";
+    m_mainWindow->trayIcon()->setToolTip(tip);
 }
 
 QVariant JsApi::getConfiguration(QString key) {
-    return settings->value(key);
+    return settings_buffer->value(key);
 }
 
 void JsApi::clearConfiguration(QString key) {
@@ -250,10 +326,13 @@ void JsApi::clearConfiguration(QString key) {
             key == "fileread_jailed"
             )
         return;
-    settings->remove(key);
+    settings_buffer->remove(key);
 }
 
-void JsApi::setConfiguration(QString key, QVariant val) {
+/* Values are buffered and written within a second. Pass sync for
+ * critical keys (credentials, state that must survive a crash).
+ */
+void JsApi::setConfiguration(QString key, QVariant val, bool sync) {
     if (
             // protected for security reasons
             key == "jail_working" ||
@@ -262,7 +341,30 @@ void JsApi::setConfiguration(QString key, QVariant val) {
             key == "fileread_jailed"
             )
         return;
-    settings->setValue(key, val);
+    settings_buffer->setValue(key, val);
+    if (sync) settings_buffer->sync();
+}
+
+/* Writes all buffered configuration changes to the ini file now.
+ * Returns false if the file could not be written.
+ */
+bool JsApi::syncConfiguration() {
+    settings_buffer->sync();
+    return settings->status() == QSettings::NoError;
+}
+
+/* Adds an instant event to the startup trace; finish writes the trace.
+ */
+void JsApi::traceMark(QString name, bool finish) {
+    StartupTrace::mark(name);
+    if (finish) StartupTrace::write();
+}
+
+/* Empty when the assets are not served from a bundle.
+ */
+QString JsApi::getAssetBundleVersion() {
+    AssetBundle *bundle = m_mainWindow->assetBundle();
+    return bundle ? bundle->version() : "";
 }
 
 void JsApi::printDebug(QByteArray input) {
@@ -272,7 +374,7 @@ void JsApi::printDebug(QByteArray input) {
 
 QVariantMap JsApi::fileHashSetup(QString path, int hashtype) {
     QVariantMap map;
-    qDebug() << "Level2 [JsApi::fileHashSetup]" << path << hashtype;
+    PLOG(lcFs, 2) << "[JsApi::fileHashSetup]" << path << hashtype;
 
     if (path.contains("..")) {
         // protect against sneaky people
@@ -280,7 +382,7 @@ QVariantMap JsApi::fileHashSetup(QString path, int hashtype) {
         map.insert("info", "pathContainsDotDot");
         return map;
     }
-    if (settings->value("fileread_jailed").toString() == "true") {
+    if (settings_buffer->value("fileread_jailed").toString() == "true") {
         path.prepend(jail_working_path);
     }
     m_fileHashFile = new QFile(path);
@@ -303,7 +405,7 @@ QVariantMap JsApi::fileHashSetup(QString path, int hashtype) {
 }
 
 QVariantMap JsApi::fileHashDo(qint64 chunksize) {
-    qDebug() << "Level2 [JsApi::fileHashDo]" << chunksize;
+    PLOG(lcFs, 2) << "[JsApi::fileHashDo]" << chunksize;
     QVariantMap map;
     QByteArray buf = m_fileHashFile->read(chunksize);
     qint64 read_bytes = buf.length();
@@ -323,12 +425,77 @@ QVariantMap JsApi::fileHashDone() {
     return map;
 }
 
+/* Hashes a file on a thread pool thread. Returns a job ID at once, or -1
+ * if the path is not allowed. Progress and the digest are reported by the
+ * fileHashProgress and fileHashFinished signals. Several jobs can run
+ * concurrently.
+ */
+qint64 JsApi::fileHashStart(QString path, int type, bool tree) {
+    PLOG(lcFs, 2) << "[JsApi::fileHashStart]" << path << type << tree;
+    if (path.contains("..")) return -1;
+    if (!HashJob::isValidType(type)) return -1;
+    if (settings_buffer->value("fileread_jailed").toString() == "true") {
+        path.prepend(jail_working_path);
+    }
+
+    m_hashJobID++;
+    HashJob *job = new HashJob(m_hashJobID, path, type, tree);
+    connect(job, &HashJob::progress, this, &JsApi::fileHashProgress);
+    connect(job, &HashJob::finished, this, &JsApi::onHashJobFinished);
+    m_hashJobs.insert(m_hashJobID, job);
+    QThreadPool::globalInstance()->start(job);
+    return m_hashJobID;
+}
+
+bool JsApi::fileHashCancel(qint64 id) {
+    HashJob *job = m_hashJobs.value(id, NULL);
+    if (!job) return false;
+    job->cancel();
+    return true;
+}
+
+int JsApi::getHashTypeXxHash64() {
+    return HashJob::XxHash64Type;
+}
+
+void JsApi::onHashJobFinished(qint64 id, QVariantMap result) {
+    PLOG(lcFs, 2) << "[JsApi::onHashJobFinished]" << id << result;
+    HashJob *job = m_hashJobs.take(id);
+    if (job) job->deleteLater();
+    emit fileHashFinished(id, result);
+}
+
+bool JsApi::storeHas(QString hash) {
+    return ContentStore::has(hash);
+}
+
+/* Adds a received file in the working jail to the store under hash. The
+ * file is hashed again with hashtype (and tree, as for fileHashStart) on
+ * the file operation pool and refused on a mismatch. Returns a file
+ * operation ID, or -1 if the path is not allowed; the outcome is reported
+ * by fileOpFinished.
+ */
+qint64 JsApi::storeImport(QString filepath_rel, QString hash, int hashtype, bool tree) {
+    QString filepath_abs = relPathToJailedAbsPath("working", filepath_rel);
+    if (filepath_abs == "" || !HashJob::isValidType(hashtype)) return -1;
+    m_fileOpID++;
+    FileOpJob *job = new FileOpJob(m_fileOpID, FileOpJob::StoreImport, filepath_abs);
+    job->setStoreHash(hash, hashtype, tree);
+    return fileOpQueue(job);
+}
+
+bool JsApi::storeLink(QString hash, QString filepath_rel) {
+    QString filepath_abs = relPathToJailedAbsPath("working", filepath_rel);
+    if (filepath_abs == "") return false;
+    return ContentStore::linkTo(hash, filepath_abs);
+}
+
 QString JsApi::getHash(QString string, int type) {
     QString result;
     QByteArray ba;
     QByteArray h;
     ba = string.toLatin1();
-    h = QCryptographicHash::hash(ba, (QCryptographicHash::Algorithm)type);
+    h = HashJob::hashData(type, ba.constData(), ba.length());
     result = QString(h.toHex());
     return result;
 }
@@ -338,22 +505,173 @@ QString JsApi::getHashFromHexStr(QString string_hex, int type) {
     QByteArray ba;
     QByteArray h;
     ba = QByteArray().fromHex(string_hex.toLatin1());
-    h = QCryptographicHash::hash(ba, (QCryptographicHash::Algorithm)type);
+    h = HashJob::hashData(type, ba.constData(), ba.length());
     result = QString(h.toHex());
     return result;
 }
 
+/* Messages from JavaScript carry their own "LevelN" prefix, which is
+ * checked before anything is formatted.
+ */
 void JsApi::debug(QString str) {
-    qDebug() << str;
+    int level = 0;
+    if (str.startsWith("Level") && str.length() > 5 && str.at(5).isDigit()) level = str.at(5).digitValue();
+    if (level > log_threshold.load() || !lcJs().isDebugEnabled()) return;
+    QMessageLogger(__FILE__, __LINE__, Q_FUNC_INFO, lcJs().categoryName()).debug("%s", qPrintable(str));
+}
+
+/* Changes logging at runtime. rules are QLoggingCategory filter rules for
+ * the categories popcorn.app, .net, .udp, .db, .fs and .js, separated by
+ * ';' (empty enables all). threshold is the highest level logged, -1
+ * logs nothing; below -1 keeps the current threshold.
+ */
+void JsApi::setLogRules(QString rules, int threshold) {
+    ::setLogRules(rules, threshold);
 }
 
 QObject * JsApi::createClient(QString id, QString location) {
     Client * c = new Client(this, id, location);
+    batchAdd(id, c, true);
     return c;
 }
 
+/* Runs many slot calls in one crossing of the JavaScript bridge. Each op
+ * is a map {object, method, args}. object is an object returned by one
+ * of the create* functions or the name it was registered under: "API",
+ * the label of a Database, the id of a Client, or a name passed to
+ * batchRegister(). Only public slots can be called.
+ *
+ * The ops run in order; a failing op does not stop the others. Returns
+ * "results" in the order of ops (null for failed ops) and, if any failed,
+ * "errors" keyed by op index.
+ */
+QVariantMap JsApi::batch(QVariantList ops) {
+    QVariantMap map;
+    QVariantList results;
+    QVariantMap errors;
+
+    for (int i = 0; i < ops.length(); i++) {
+        QVariantMap op = ops.at(i).toMap();
+        QVariant object = op.value("object");
+        QObject *obj = NULL;
+        if ((int)object.type() == QMetaType::QObjectStar) {
+            obj = qvariant_cast<QObject *>(object);
+        } else {
+            obj = m_batchObjects.value(object.toString());
+        }
+
+        QString error;
+        QVariant result;
+        if (!obj) {
+            error = "objectNotFound";
+        } else {
+            result = batchInvoke(obj, op.value("method").toString(), op.value("args").toList(), &error);
+        }
+        if (error != "") {
+            PLOG(lcJs, 1) << "[JsApi::batch]" << i << object << op.value("method") << error;
+            errors.insert(QString::number(i), error);
+        }
+        results.append(result);
+    }
+
+    map.insert("status", errors.isEmpty() ? "OK" : "Error");
+    map.insert("results", results);
+    if (!errors.isEmpty()) map.insert("errors", errors);
+    return map;
+}
+
+/* Registers obj under name for batch(), or removes the name if obj is
+ * NULL. Returns false if the name is reserved or taken, see batchAdd.
+ */
+bool JsApi::batchRegister(QString name, QObject *obj) {
+    if (obj) return batchAdd(name, obj);
+    if (name == "API") return false;
+    m_batchObjects.remove(name);
+    return true;
+}
+
+/* "API" is reserved. Otherwise a name stays with its object as long as
+ * that exists, unless replace is given: createDatabase and createClient
+ * re-point their label or id to the newest object, which is also the one
+ * Javascript now holds. Refused objects can still be passed to batch()
+ * directly.
+ */
+bool JsApi::batchAdd(QString name, QObject *obj, bool replace) {
+    QObject *existing = m_batchObjects.value(name);
+    if (name == "API" || (!replace && existing && existing != obj)) {
+        PLOG(lcJs, 0) << "[JsApi::batchAdd] name reserved or taken, not registered" << name;
+        return false;
+    }
+    m_batchObjects.insert(name, obj);
+    return true;
+}
+
+/* Finds the public slot by name and argument count, caching the method
+ * index per class, converts the arguments to the parameter types and
+ * calls it directly.
+ */
+QVariant JsApi::batchInvoke(QObject *obj, QString method, QVariantList args, QString *error) {
+    const QMetaObject *mo = obj->metaObject();
+    if (args.length() > 10) {
+        *error = "tooManyArguments";
+        return QVariant();
+    }
+
+    QString key = QString("%1::%2/%3").arg(mo->className()).arg(method).arg(args.length());
+    int index = m_batchMethods.value(key, -1);
+    if (index < 0) {
+        QByteArray name = method.toLatin1();
+        for (int m = 0; m < mo->methodCount(); m++) {
+            QMetaMethod mm = mo->method(m);
+            if (mm.methodType() == QMetaMethod::Slot && mm.access() == QMetaMethod::Public && mm.name() == name && mm.parameterCount() == args.length()) {
+                index = m;
+                break;
+            }
+        }
+        if (index < 0) {
+            *error = "methodNotFound";
+            return QVariant();
+        }
+        m_batchMethods.insert(key, index);
+    }
+    QMetaMethod mm = mo->method(index);
+
+    QGenericArgument argv[10];
+    for (int i = 0; i < args.length(); i++) {
+        int type = mm.parameterType(i);
+        if (type == QMetaType::QVariant) {
+            argv[i] = QGenericArgument("QVariant", &args[i]);
+            continue;
+        }
+        if (!args[i].convert(type)) {
+            *error = "argumentNotConvertible";
+            return QVariant();
+        }
+        argv[i] = QGenericArgument(QMetaType::typeName(type), args[i].constData());
+    }
+
+    int return_type = mm.returnType();
+    QVariant result;
+    QGenericReturnArgument ret;
+    if (return_type == QMetaType::QVariant) {
+        ret = QGenericReturnArgument("QVariant", &result);
+    } else if (return_type != QMetaType::Void) {
+        result = QVariant(return_type, (const void *)NULL);
+        ret = QGenericReturnArgument(mm.typeName(), result.data());
+    }
+
+    bool ok = mm.invoke(obj, Qt::DirectConnection, ret,
+                        argv[0], argv[1], argv[2], argv[3], argv[4],
+                        argv[5], argv[6], argv[7], argv[8], argv[9]);
+    if (!ok) {
+        *error = "invokeFailed";
+        return QVariant();
+    }
+    return result;
+}
+
 void JsApi::playSound(QString name) {
-    qDebug() << "Level1 [JsApi::playSound]";
+    PLOG(lcJs, 1) << "[JsApi::playSound]";
 #ifdef Q_OS_LINUX
     QStringList args;
     args.append(name);
@@ -413,7 +731,7 @@ void JsApi::windowShowNormal() {
 
 void JsApi::windowMinimize() {
     m_mainWindow->setWindowState(Qt::WindowMinimized);
-    settings->setValue("minified_state", "true");
+    settings_buffer->setValue("minified_state", "true");
 }
 
 QString JsApi::getVersion() {
@@ -425,7 +743,7 @@ QString JsApi::getVersion() {
 qint64 JsApi::fileSize(QString infilepath_abs_or_rel) {
     QString infilepath_abs;
     if (infilepath_abs_or_rel.contains("..")) return -4;
-    if (settings->value("fileread_jailed").toString() == "true") {
+    if (settings_buffer->value("fileread_jailed").toString() == "true") {
         infilepath_abs = jail_working_path + infilepath_abs_or_rel;
     } else {
         infilepath_abs = infilepath_abs_or_rel;
@@ -488,7 +806,7 @@ bool JsApi::fileCopy(QString infilepath_abs_or_rel, QString outfilepath_rel) {
     QString infilepath_abs;
     if (infilepath_abs_or_rel.contains("..")) return false;
     if (outfilepath_rel.contains("..")) return false;
-    if (settings->value("fileread_jailed").toString() == "true") {
+    if (settings_buffer->value("fileread_jailed").toString() == "true") {
         infilepath_abs = jail_working_path + infilepath_abs_or_rel;
     } else {
         infilepath_abs = infilepath_abs_or_rel;
@@ -496,6 +814,78 @@ bool JsApi::fileCopy(QString infilepath_abs_or_rel, QString outfilepath_rel) {
     return QFile().copy(infilepath_abs, jail_working_path + outfilepath_rel);
 }
 
+qint64 JsApi::fileOpStart(FileOpJob::Type type, QString src_abs, QString dst_abs, QByteArray content, int open_mode) {
+    m_fileOpID++;
+    return fileOpQueue(new FileOpJob(m_fileOpID, type, src_abs, dst_abs, content, open_mode));
+}
+
+/* Takes ownership of a job created with the ID m_fileOpID.
+ */
+qint64 JsApi::fileOpQueue(FileOpJob *job) {
+    connect(job, &FileOpJob::progress, this, &JsApi::fileOpProgress);
+    connect(job, &FileOpJob::finished, this, &JsApi::onFileOpFinished);
+    m_fileOps.insert(m_fileOpID, job);
+    m_fileOpPool->start(job);
+    return m_fileOpID;
+}
+
+/* The asynchronous file operations return a job ID at once, or -1 if a
+ * path is not allowed. They are queued and run on a pool of
+ * fileOpSetConcurrency() threads. Progress and the outcome are reported
+ * by the fileOpProgress and fileOpFinished signals.
+ */
+qint64 JsApi::fileCopyAsync(QString infilepath_abs_or_rel, QString outfilepath_rel) {
+    PLOG(lcFs, 2) << "[JsApi::fileCopyAsync]" << infilepath_abs_or_rel << outfilepath_rel;
+    QString infilepath_abs;
+    if (infilepath_abs_or_rel.contains("..")) return -1;
+    if (outfilepath_rel.contains("..")) return -1;
+    if (settings_buffer->value("fileread_jailed").toString() == "true") {
+        infilepath_abs = jail_working_path + infilepath_abs_or_rel;
+    } else {
+        infilepath_abs = infilepath_abs_or_rel;
+    }
+    return fileOpStart(FileOpJob::Copy, infilepath_abs, jail_working_path + outfilepath_rel);
+}
+
+qint64 JsApi::fileRenameAsync(QString infilepath_rel, QString outfilepath_rel) {
+    PLOG(lcFs, 2) << "[JsApi::fileRenameAsync]" << infilepath_rel << outfilepath_rel;
+    if (infilepath_rel.contains("..")) return -1;
+    if (outfilepath_rel.contains("..")) return -1;
+    return fileOpStart(FileOpJob::Rename, jail_working_path + infilepath_rel, jail_working_path + outfilepath_rel);
+}
+
+qint64 JsApi::fileWriteAsync(QString jail_type, QString filepath_rel, QString content, int open_mode) {
+    PLOG(lcFs, 2) << "[JsApi::fileWriteAsync]" << jail_type << filepath_rel << open_mode;
+    QString filepath_abs = relPathToJailedAbsPath(jail_type, filepath_rel);
+    if (filepath_abs == "") return -1;
+    return fileOpStart(FileOpJob::Write, "", filepath_abs, content.toUtf8(), open_mode);
+}
+
+qint64 JsApi::dirRemoveAsync(QString jail_type, QString path_rel) {
+    PLOG(lcFs, 2) << "[JsApi::dirRemoveAsync]" << jail_type << path_rel;
+    QString path_abs = relPathToJailedAbsPath(jail_type, path_rel);
+    if (path_abs == "") return -1;
+    return fileOpStart(FileOpJob::RemoveDir, path_abs);
+}
+
+bool JsApi::fileOpCancel(qint64 id) {
+    FileOpJob *job = m_fileOps.value(id, NULL);
+    if (!job) return false;
+    job->cancel();
+    return true;
+}
+
+void JsApi::fileOpSetConcurrency(int count) {
+    if (count < 1) return;
+    m_fileOpPool->setMaxThreadCount(count);
+}
+
+void JsApi::onFileOpFinished(qint64 id, QVariantMap result) {
+    PLOG(lcFs, 2) << "[JsApi::onFileOpFinished]" << id << result;
+    FileOpJob *job = m_fileOps.take(id);
+    if (job) job->deleteLater();
+    emit fileOpFinished(id, result);
+}
 
 bool JsApi::fileExists(QString jail_type, QString filepath_rel) {
     QString filepath_abs = relPathToJailedAbsPath(jail_type, filepath_rel);
@@ -514,6 +904,81 @@ bool JsApi::fileRemove(QString jail_type, QString filepath_rel) {
     return QDir().remove(filepath_abs);
 }
 
+/* Opens a file for reading in ranges or lines, for files too large for
+ * fileRead. Returns the handle and the file size.
+ */
+QVariantMap JsApi::fileOpen(QString jail_type, QString filepath_rel) {
+    QVariantMap map;
+    QString filepath_abs = relPathToJailedAbsPath(jail_type, filepath_rel);
+    if (filepath_abs == "") {
+        map.insert("status", "Error");
+        map.insert("info", "pathNotAllowed");
+        return map;
+    }
+
+    // only the application directory is never written while open; a
+    // mapped file truncated by another writer would crash with SIGBUS
+    FileHandle *fh = new FileHandle(filepath_abs, jail_type == "application");
+    if (!fh->open()) {
+        delete fh;
+        map.insert("status", "Error");
+        map.insert("info", "fileCannotOpen");
+        return map;
+    }
+
+    m_fileHandleID++;
+    m_fileHandles.insert(m_fileHandleID, fh);
+    map.insert("status", "OK");
+    map.insert("handle", m_fileHandleID);
+    map.insert("size", fh->size());
+    return map;
+}
+
+/* Returns at most FILE_READ_RANGE_MAX bytes starting at pos, as UTF-8
+ * text or, for binary data, as hex.
+ */
+QString JsApi::fileReadRange(int handle, qint64 pos, qint64 length, bool hex) {
+    FileHandle *fh = m_fileHandles.value(handle, NULL);
+    if (!fh) return "";
+    QByteArray ba = fh->read(pos, qMin(length, (qint64)FILE_READ_RANGE_MAX));
+    if (hex) return QString::fromLatin1(ba.toHex());
+    return QString::fromUtf8(ba);
+}
+
+/* Lines over FILE_READ_RANGE_MAX bytes are cut; "truncated" lists the
+ * indices of such lines.
+ */
+QVariantMap JsApi::fileReadLines(int handle, int count) {
+    QVariantMap map;
+    FileHandle *fh = m_fileHandles.value(handle, NULL);
+    if (!fh) {
+        map.insert("status", "Error");
+        map.insert("info", "noSuchHandle");
+        return map;
+    }
+    bool done;
+    QList<int> truncated;
+    QStringList lines = fh->readLines(count, FILE_READ_RANGE_MAX, &done, &truncated);
+    QVariantList truncated_list;
+    foreach (int index, truncated) truncated_list.append(index);
+    map.insert("status", "OK");
+    map.insert("lines", lines);
+    map.insert("truncated", truncated_list);
+    map.insert("pos", fh->pos());
+    map.insert("done", done);
+    return map;
+}
+
+bool JsApi::fileSeek(int handle, qint64 pos) {
+    FileHandle *fh = m_fileHandles.value(handle, NULL);
+    if (!fh) return false;
+    return fh->seek(pos);
+}
+
+void JsApi::fileClose(int handle) {
+    delete m_fileHandles.take(handle);
+}
+
 QStringList JsApi::ls(QString jail_type, QString path_rel, QStringList wildcard, int filter) {
     QString path_abs = relPathToJailedAbsPath(jail_type, path_rel);
     if (path_abs == "") return QStringList();
@@ -526,6 +991,31 @@ QStringList JsApi::ls(QString jail_type, QString path_rel, QStringList wildcard,
 }
 
 
+/* Like ls, but returns name, size, mtime (ms since epoch) and type of
+ * every entry, so that no further fileSize/fileExists calls are needed.
+ */
+QVariantList JsApi::lsInfo(QString jail_type, QString path_rel, QStringList wildcard, int filter) {
+    QVariantList list;
+    QString path_abs = relPathToJailedAbsPath(jail_type, path_rel);
+    if (path_abs == "") return list;
+
+    QDir d(path_abs);
+    if (!d.exists()) return list;
+
+    d.setFilter((QDir::Filter)filter);
+    foreach (QFileInfo info, d.entryInfoList(wildcard)) {
+        list.append(DirWatcher::entryInfo(info));
+    }
+    return list;
+}
+
+QObject *JsApi::createDirWatcher(QString jail_type, QString path_rel, bool watch_files) {
+    QString path_abs = relPathToJailedAbsPath(jail_type, path_rel);
+    if (path_abs == "" || !QDir(path_abs).exists()) return (QObject *)NULL;
+    DirWatcher *w = new DirWatcher(this, path_abs, watch_files);
+    return w;
+}
+
 bool JsApi::dirRemove(QString jail_type, QString path_rel) {
     QString path_abs = relPathToJailedAbsPath(jail_type, path_rel);
     if (path_abs == "") return false;
@@ -538,54 +1028,47 @@ bool JsApi::dirMake(QString jail_type, QString path_rel) {
     return QDir().mkpath(path_abs);
 }
 
-bool JsApi::dirCopy(QString dst_path_rel, QString dst_jail_type, QString src_path_abs_or_rel, QString src_jail_type) {
+/* Resolves the source of a directory copy. Depending on fileread_jailed,
+ * the source is either relative to a jail or an absolute path.
+ */
+QString JsApi::dirCopySrcPath(QString src_path_abs_or_rel, QString src_jail_type) {
+    if (settings_buffer->value("fileread_jailed").toString() == "true") {
+        return relPathToJailedAbsPath(src_jail_type, src_path_abs_or_rel);
+    }
+    return src_path_abs_or_rel;
+}
+
+/* Blocks until the copy is complete; prefer createDirCopier for anything
+ * but small trees.
+ */
+bool JsApi::dirCopy(QString dst_path_rel, QString dst_jail_type, QString src_path_abs_or_rel, QString src_jail_type, bool mirror) {
 
-    qDebug() << "Level3 [JsApi::dirCopy]" << dst_path_rel << dst_jail_type << src_path_abs_or_rel << src_jail_type;
+    PLOG(lcFs, 3) << "[JsApi::dirCopy]" << dst_path_rel << dst_jail_type << src_path_abs_or_rel << src_jail_type << mirror;
 
     QString dst_path_abs = relPathToJailedAbsPath(dst_jail_type, dst_path_rel);
-    qDebug() << "Level3 [JsApi::dirCopy] dst_path_abs" << dst_path_abs;
+    PLOG(lcFs, 3) << "[JsApi::dirCopy] dst_path_abs" << dst_path_abs;
     if (dst_path_abs == "") return false;
 
-    QString src_path_abs;
-    if (settings->value("fileread_jailed").toString() == "true") {
-        src_path_abs = relPathToJailedAbsPath(src_jail_type, src_path_abs_or_rel);
-        qDebug() << "Level3 [JsApi::dirCopy] src_path_abs" << src_path_abs;
-        if (src_path_abs == "") return false;
-    } else {
-        src_path_abs = src_path_abs_or_rel;
-    }
+    QString src_path_abs = dirCopySrcPath(src_path_abs_or_rel, src_jail_type);
+    PLOG(lcFs, 3) << "[JsApi::dirCopy] src_path_abs" << src_path_abs;
+    if (src_path_abs == "") return false;
 
-    QDir dst_dir(dst_path_abs);
-    if (! dst_dir.exists()) {
-        qDebug() << "Level0 [JsApi::dirCopy] dst dir not existing";
-        return false;
-    }
+    DirCopier copier(NULL, src_path_abs, dst_path_abs, mirror);
+    return copier.exec().value("status").toString() == "OK";
+}
 
-    QDir src_dir(src_path_abs);
-    if (! src_dir.exists()) {
-        qDebug() << "Level0 [JsApi::dirCopy] src dir not existing";
-        return false;
-    }
+/* Like dirCopy, but returns a DirCopier. Call run() on it to copy in the
+ * background; it reports progress() and finished(info).
+ */
+QObject *JsApi::createDirCopier(QString dst_path_rel, QString dst_jail_type, QString src_path_abs_or_rel, QString src_jail_type, bool mirror) {
+    QString dst_path_abs = relPathToJailedAbsPath(dst_jail_type, dst_path_rel);
+    if (dst_path_abs == "") return (QObject *)NULL;
 
-    bool result;
-    foreach (QString subdirpath, src_dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot)) {
-        QString dst_path_new = dst_path_abs + "/" + subdirpath;
-        result = QDir().mkpath(dst_path_new); // creates parent dirs
-        if (!result) return false;
-        qDebug() << "Level0 [JsApi::dirCopy]  creating dir" << result << dst_path_new;
-        result = dirCopy(dst_path_rel + "/" + subdirpath,
-                         dst_jail_type,
-                         src_path_abs_or_rel + "/" + subdirpath,
-                         src_jail_type); // recursion
-        if (!result) return false;
-    }
+    QString src_path_abs = dirCopySrcPath(src_path_abs_or_rel, src_jail_type);
+    if (src_path_abs == "") return (QObject *)NULL;
 
-    foreach (QString fname, src_dir.entryList(QDir::Files)) {
-        bool result = QFile::copy(src_path_abs + "/" + fname, dst_path_abs + "/" + fname);
-        if (!result) return false;
-        qDebug() << "Level0 [JsApi::dirCopy]   copy file" << result << fname;
-    }
-    return true;
+    DirCopier *copier = new DirCopier(this, src_path_abs, dst_path_abs, mirror);
+    return copier;
 }
 
 
@@ -605,7 +1088,7 @@ double JsApi::getIdleTime() {
 
     if (!success) {
         DWORD err = GetLastError();
-        qDebug() << "Level1 [JsApi::getIdleTime] ERROR:" << err;
+        PLOG(lcJs, 1) << "[JsApi::getIdleTime] ERROR:" << err;
     } else {
         lastActiveTimestamp = inputInfo.dwTime;
     }
@@ -627,15 +1110,15 @@ double JsApi::getIdleTime() {
 
 QString JsApi::getSystemUserName() {
     QString name;
-    qDebug() << "Level1 [JsApi::getSystemUserName]: called";
+    PLOG(lcJs, 1) << "[JsApi::getSystemUserName]: called";
 #ifdef Q_OS_WIN
     DWORD bufCharCount = 32767;
     TCHAR infoBuf[32767];
     if ( ! GetUserName(infoBuf, &bufCharCount) ) {
-        qDebug() << "Level1 [JsApi::getSystemUserName]: error in WINDOWS API GetUserName";
+        PLOG(lcJs, 1) << "[JsApi::getSystemUserName]: error in WINDOWS API GetUserName";
         return "ERROR_IN_USER_NAME";
     } else {
-        qDebug() << "Level1 [JsApi::getSystemUserName]: found out user name" << name;
+        PLOG(lcJs, 1) << "[JsApi::getSystemUserName]: found out user name" << name;
         name = QString::fromWCharArray(infoBuf);
         return name;
     }
@@ -652,16 +1135,16 @@ QString JsApi::getSystemUserName() {
 
 QString JsApi::getSystemComputerName() {
     QString name;
-    qDebug() << "Level1 [JsApi::getSystemComputerName]: called";
+    PLOG(lcJs, 1) << "[JsApi::getSystemComputerName]: called";
 #ifdef Q_OS_WIN
     DWORD bufCharCount = 32767;
     TCHAR infoBuf[32767];
     if ( ! GetComputerName(infoBuf, &bufCharCount) ) {
-        qDebug() << "Level1 [JsApi::getSystemComputerName]: error in WINDOWS API GetComputerName";
+        PLOG(lcJs, 1) << "[JsApi::getSystemComputerName]: error in WINDOWS API GetComputerName";
         return "ERROR_IN_COMPUTER_NAME";
     } else {
         name = QString::fromWCharArray(infoBuf);
-        qDebug() << "Level1 [JsApi::getSystemComputerName]: found out computer name" << name;
+        PLOG(lcJs, 1) << "[JsApi::getSystemComputerName]: found out computer name" << name;
         return name;
     }
 #else
@@ -674,7 +1157,7 @@ QStringList JsApi::getMyLocalIpAddresses() {
     QStringList address_list;
     foreach (const QHostAddress &address, QNetworkInterface::allAddresses()) {
         QString address_string = address.toString();
-        qDebug() << "Level2 [JsApi::getMyLocalIpAddress]: IP" << address_string;
+        PLOG(lcJs, 2) << "[JsApi::getMyLocalIpAddress]: IP" << address_string;
         address_list.append(address.toString());
     }
     return address_list;
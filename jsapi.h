@@ -33,6 +33,10 @@
 #include <QSystemTrayIcon>
 #include <QCryptographicHash>
 #include <QUdpSocket>
+#include <QThreadPool>
+#include <QPointer>
+#include <QHash>
+#include <QMetaMethod>
 
 #include "jsapi.h"
 #include "mainwindow.h"
@@ -42,6 +46,15 @@
 #include "process_manager.h"
 #include "downloader.h"
 #include "database.h"
+#include "retention.h"
+#include "hashjob.h"
+#include "contentstore.h"
+#include "dircopier.h"
+#include "filehandle.h"
+#include "dirwatcher.h"
+#include "fileopjob.h"
+#include "unzipper.h"
+#include "codec.h"
 
 #ifdef Q_OS_WIN
     #include <windows.h>
@@ -74,6 +87,8 @@ extern QString application_path;
 extern QString home_path;
 extern QString jail_working_path;
 
+#define FILE_READ_RANGE_MAX 16777216
+
 extern "C" {
  void randombytes(char *, qint64);
 }
@@ -99,29 +114,59 @@ private:
     QCryptographicHash *m_fileHashCrypto;
     QFile *m_fileHashFile;
 
+    QMap<qint64, HashJob *> m_hashJobs;
+    qint64 m_hashJobID;
+
+    QMap<int, FileHandle *> m_fileHandles;
+    int m_fileHandleID;
+
+    QByteArray m_codecBuffer;
+
+    QMap<QString, QPointer<QObject> > m_batchObjects;
+    QHash<QString, int> m_batchMethods;
+
+    QThreadPool *m_fileOpPool;
+    QMap<qint64, FileOpJob *> m_fileOps;
+    qint64 m_fileOpID;
+
     QString relPathToJailedAbsPath(QString jail_type, QString path_rel);
+    QString dirCopySrcPath(QString src_path_abs_or_rel, QString src_jail_type);
+    QVariant batchInvoke(QObject *obj, QString method, QVariantList args, QString *error);
+    bool batchAdd(QString name, QObject *obj, bool replace = false);
+    qint64 fileOpStart(FileOpJob::Type type, QString src_abs, QString dst_abs = "", QByteArray content = QByteArray(), int open_mode = 2);
+    qint64 fileOpQueue(FileOpJob *job);
 
     
 signals:
     void optionsDialogAccepted();
     void trayMessageClicked();
     void trayIconActivated(int reason);
+    void fileHashProgress(qint64 id, qint64 bytes, qint64 total);
+    void fileHashFinished(qint64 id, QVariantMap result);
+    void fileOpProgress(qint64 id, qint64 done, qint64 total);
+    void fileOpFinished(qint64 id, QVariantMap result);
 
 private slots:
-
+    void onHashJobFinished(qint64 id, QVariantMap result);
+    void onFileOpFinished(qint64 id, QVariantMap result);
 
 public slots:
     // public slot methods are exposed to JavaScript
     void shutdown();
     void restart();
 
-    void setConfiguration(QString key, QVariant val);
+    void setConfiguration(QString key, QVariant val, bool sync = false);
+    bool syncConfiguration();
     QVariant getConfiguration(QString key);
     void clearConfiguration(QString key);
 
     QObject * createDatabase(QString label);
+    QVariantMap benchmarkDatabase(int rows = 10000);
+    QObject * createRetention(QObject *database, QVariantMap config);
     QObject * createDownloader(QString label, QString path, QString filename);
     QObject * createClient(QString id, QString location);
+    QVariantMap batch(QVariantList ops);
+    bool batchRegister(QString name, QObject *obj);
     QObject * createUdpServer();
     QObject * createTcpServer();
 
@@ -142,7 +187,10 @@ public slots:
     bool dirMake(QString jail_type, QString path_rel);
     bool dirRemove(QString jail_type, QString path_rel);
     QStringList ls(QString jail_type, QString path_rel, QStringList wildcard, int filter = (QDir::Files | QDir::Hidden | QDir::Dirs | QDir::NoDotAndDotDot));
-    bool dirCopy(QString dst_path_rel, QString dst_jail_type, QString src_path_abs_or_rel, QString src_jail_type = "");
+    QVariantList lsInfo(QString jail_type, QString path_rel, QStringList wildcard, int filter = (QDir::Files | QDir::Hidden | QDir::Dirs | QDir::NoDotAndDotDot));
+    QObject *createDirWatcher(QString jail_type, QString path_rel, bool watch_files = false);
+    bool dirCopy(QString dst_path_rel, QString dst_jail_type, QString src_path_abs_or_rel, QString src_jail_type = "", bool mirror = false);
+    QObject *createDirCopier(QString dst_path_rel, QString dst_jail_type, QString src_path_abs_or_rel, QString src_jail_type = "", bool mirror = false);
 
     // file operations
     qint64 fileSize(QString infilepath_abs_or_rel);
@@ -150,15 +198,34 @@ public slots:
     qint64 fileWrite(QString jail_type, QString filepath_rel, QString content, int open_mode = 2);
     QString fileRead(QString jail_type, QString filepath_rel);
     bool fileCopy(QString infilepath_abs_or_rel, QString outfilepath_rel);
+    qint64 fileCopyAsync(QString infilepath_abs_or_rel, QString outfilepath_rel);
+    qint64 fileRenameAsync(QString infilepath_rel, QString outfilepath_rel);
+    qint64 fileWriteAsync(QString jail_type, QString filepath_rel, QString content, int open_mode = 2);
+    qint64 dirRemoveAsync(QString jail_type, QString path_rel);
+    bool fileOpCancel(qint64 id);
+    void fileOpSetConcurrency(int count);
     bool fileExists(QString jail_type, QString filepath_rel);
     bool fileRemove(QString jail_type, QString filepath_rel);
 
+    QVariantMap fileOpen(QString jail_type, QString filepath_rel);
+    QString fileReadRange(int handle, qint64 pos, qint64 length, bool hex = false);
+    QVariantMap fileReadLines(int handle, int count = 1000);
+    bool fileSeek(int handle, qint64 pos);
+    void fileClose(int handle);
+
     QVariantMap fileHashSetup(QString path, int type = 1);
     QVariantMap fileHashDo(qint64 chunksize = 1000000);
     QVariantMap fileHashDone();
+    qint64 fileHashStart(QString path, int type = 1, bool tree = false);
+    bool fileHashCancel(qint64 id);
+
+    bool storeHas(QString hash);
+    qint64 storeImport(QString filepath_rel, QString hash, int hashtype = 1, bool tree = false);
+    bool storeLink(QString hash, QString filepath_rel);
 
     QString getHash(QString string, int type = 1); // MD5 default
     QString getHashFromHexStr(QString string_hex, int type = 1);
+    int getHashTypeXxHash64();
 
     void showTrayMessage(QString title, QString msg, int type = 0, int delay = 1000);
     void setTrayToolTip(QString tip);
@@ -171,6 +238,9 @@ public slots:
 
     void printDebug(QByteArray input);
     void debug(QString str);
+    void setLogRules(QString rules, int threshold = -2);
+    void traceMark(QString name, bool finish = false);
+    QString getAssetBundleVersion();
 
 
     void windowSetFlags(int flgs);
@@ -188,10 +258,11 @@ public slots:
 
 
 
-    QString mapToHex(QVariantMap map);
+    QString mapToHex(QVariantMap map, QString format = "");
     QVariantMap hexToMap(QString hex);
-    QByteArray mapToByteArray(QVariantMap map);
+    QByteArray mapToByteArray(QVariantMap map, QString format = "");
     QVariantMap byteArrayToMap(QByteArray ba);
+    QVariantMap benchmarkCodec(QVariantMap sample, int iterations = 10000);
 
 #ifdef Q_OS_WIN
     QObject *runUpgrader(bool detach = true);
@@ -0,0 +1,228 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "logger.h"
+
+#include <QFileInfo>
+#include <QDateTime>
+
+#ifdef Q_OS_WIN
+    #include <io.h>
+    #define LOGGER_WRITE _write
+#else
+    #include <unistd.h>
+    #define LOGGER_WRITE ::write
+#endif
+
+#define LOGGER_CAPACITY 16384
+#define LOGGER_BATCH 1024
+#define LOGGER_IDLE_MS 50
+#define LOGGER_KEEP 3
+
+Logger *Logger::s_instance = NULL;
+
+Logger::Logger(QString path, qint64 max_size) :
+    QThread(0)
+{
+    m_path = path;
+    m_max_size = max_size;
+    m_mask = LOGGER_CAPACITY - 1;
+    m_cells = new Cell[LOGGER_CAPACITY];
+    for (quint32 i = 0; i < LOGGER_CAPACITY; i++) {
+        m_cells[i].sequence.store(i);
+    }
+    m_enqueuePos = 0;
+    m_dequeuePos = 0;
+    m_dropped = 0;
+    m_stopping = 0;
+    m_fd = -1;
+}
+
+Logger::~Logger() {
+    delete[] m_cells;
+}
+
+/* Keeps the log of the previous run as name.1, so that it is still
+ * there after a crash, and starts the background thread.
+ */
+Logger *Logger::start(QString path, qint64 max_size) {
+    if (s_instance) return s_instance;
+    s_instance = new Logger(path, max_size);
+    if (QFileInfo(path).size() > 0) s_instance->rotate();
+    s_instance->m_file.setFileName(path);
+    s_instance->openFile();
+    s_instance->QThread::start(QThread::LowPriority);
+    return s_instance;
+}
+
+Logger *Logger::instance() {
+    return s_instance;
+}
+
+/* Called from any thread.
+ */
+void Logger::log(const QString &msg) {
+    QByteArray line = QDateTime::currentDateTime().toString("yyyyMMddHHmmss").toLatin1();
+    line.append(' ');
+    line.append(msg.toUtf8());
+    line.append("\r\n");
+    if (!enqueue(line)) m_dropped.fetchAndAddRelaxed(1);
+}
+
+bool Logger::enqueue(const QByteArray &data) {
+    quint32 pos = m_enqueuePos.loadAcquire();
+    Cell *cell;
+    while (true) {
+        cell = &m_cells[pos & m_mask];
+        qint32 diff = (qint32)(cell->sequence.loadAcquire() - pos);
+        if (diff == 0) {
+            if (m_enqueuePos.testAndSetRelaxed(pos, pos + 1)) break;
+            pos = m_enqueuePos.loadAcquire();
+        } else if (diff < 0) {
+            return false; // full
+        } else {
+            pos = m_enqueuePos.loadAcquire();
+        }
+    }
+    cell->data = data;
+    cell->sequence.storeRelease(pos + 1);
+    return true;
+}
+
+/* Safe for several consumers, so that flushOnCrash() can drain while the
+ * background thread is running.
+ */
+bool Logger::dequeue(QByteArray &data) {
+    quint32 pos = m_dequeuePos.loadAcquire();
+    Cell *cell;
+    while (true) {
+        cell = &m_cells[pos & m_mask];
+        qint32 diff = (qint32)(cell->sequence.loadAcquire() - (pos + 1));
+        if (diff == 0) {
+            if (m_dequeuePos.testAndSetRelaxed(pos, pos + 1)) break;
+            pos = m_dequeuePos.loadAcquire();
+        } else if (diff < 0) {
+            return false; // empty
+        } else {
+            pos = m_dequeuePos.loadAcquire();
+        }
+    }
+    data = cell->data;
+    cell->data = QByteArray();
+    cell->sequence.storeRelease(pos + m_mask + 1);
+    return true;
+}
+
+/* Writes up to LOGGER_BATCH lines with one write. Returns false if the
+ * ring was empty.
+ */
+bool Logger::drain() {
+    QByteArray batch;
+    QByteArray line;
+    int count = 0;
+    while (count < LOGGER_BATCH && dequeue(line)) {
+        batch.append(line);
+        count++;
+    }
+    int dropped = m_dropped.fetchAndStoreRelaxed(0);
+    if (dropped > 0) {
+        batch.append(QString("%1 [Logger] %2 messages dropped\r\n").arg(QDateTime::currentDateTime().toString("yyyyMMddHHmmss")).arg(dropped).toLatin1());
+    }
+    if (batch.isEmpty()) return false;
+
+    m_file.write(batch);
+    if (m_max_size > 0 && m_file.size() > m_max_size) {
+        closeFile();
+        rotate();
+        openFile();
+    }
+    return true;
+}
+
+void Logger::openFile() {
+    m_file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Unbuffered);
+    m_fd.storeRelease(m_file.isOpen() ? m_file.handle() : -1);
+}
+
+void Logger::closeFile() {
+    m_fd.storeRelease(-1);
+    m_file.close();
+}
+
+void Logger::rotate() {
+    QFile::remove(m_path + "." + QString::number(LOGGER_KEEP));
+    for (int i = LOGGER_KEEP - 1; i >= 1; i--) {
+        QFile::rename(m_path + "." + QString::number(i), m_path + "." + QString::number(i + 1));
+    }
+    QFile::rename(m_path, m_path + ".1");
+}
+
+void Logger::run() {
+    while (!m_stopping.loadAcquire()) {
+        if (!drain()) msleep(LOGGER_IDLE_MS);
+    }
+    while (drain()) {}
+    closeFile();
+}
+
+void Logger::stop() {
+    if (m_stopping.fetchAndStoreOrdered(1)) return;
+    if (QThread::currentThread() != this) wait();
+}
+
+/* Claims the next queued line and writes it with one ::write(). Unlike
+ * dequeue(), the cell's QByteArray is left alone, so that no memory is
+ * freed; the process is going down anyway.
+ */
+bool Logger::writeNextRaw(int fd) {
+    quint32 pos = m_dequeuePos.loadAcquire();
+    Cell *cell;
+    while (true) {
+        cell = &m_cells[pos & m_mask];
+        qint32 diff = (qint32)(cell->sequence.loadAcquire() - (pos + 1));
+        if (diff == 0) {
+            if (m_dequeuePos.testAndSetRelaxed(pos, pos + 1)) break;
+            pos = m_dequeuePos.loadAcquire();
+        } else if (diff < 0) {
+            return false; // empty
+        } else {
+            pos = m_dequeuePos.loadAcquire();
+        }
+    }
+    LOGGER_WRITE(fd, cell->data.constData(), cell->data.size());
+    return true;
+}
+
+/* Best effort, for signal handlers: writes what is still queued from the
+ * crashing thread using only atomics and ::write(), so that it cannot
+ * deadlock on a heap lock held by the crashed code. The background
+ * thread may still be writing its own batch; lines are not torn, since
+ * the file is opened in append mode and each line is one write.
+ */
+void Logger::flushOnCrash() {
+    Logger *logger = s_instance;
+    if (!logger) return;
+    logger->m_stopping.storeRelease(1);
+    int fd = logger->m_fd.loadAcquire();
+    if (fd < 0) return;
+    while (logger->writeNextRaw(fd)) {}
+}
@@ -0,0 +1,92 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <QThread>
+#include <QFile>
+#include <QByteArray>
+#include <QAtomicInt>
+#include <QAtomicInteger>
+
+/* Writes log lines to a file from a background thread.
+ *
+ * log() only formats the line and puts it into a bounded lock-free ring
+ * (Vyukov's queue with a sequence number per cell), so logging threads
+ * never block on the file or on each other. When the ring is full, lines
+ * are dropped and the number of dropped lines is written instead. The
+ * background thread drains the ring in batches into the file, which
+ * stays open, and rotates it when it grows beyond max_size, keeping
+ * LOGGER_KEEP old files (name.1 is the newest).
+ *
+ * stop() writes out everything queued and closes the file; it is called
+ * on exit and on fatal messages. flushOnCrash() is a best-effort flush
+ * for signal handlers: it neither allocates nor touches the QFile, and
+ * writes the queued lines with ::write() to the current file descriptor.
+ */
+class Logger : public QThread
+{
+public:
+    static Logger *start(QString path, qint64 max_size);
+    static Logger *instance();
+    static void flushOnCrash();
+
+    void log(const QString &msg);
+    void stop();
+
+protected:
+    void run();
+
+private:
+    explicit Logger(QString path, qint64 max_size);
+    ~Logger();
+
+    struct Cell {
+        QAtomicInteger<quint32> sequence;
+        QByteArray data;
+    };
+
+    static Logger *s_instance;
+
+    QString m_path;
+    qint64 m_max_size;
+    QFile m_file;
+    QAtomicInt m_fd; // of m_file, for flushOnCrash(); -1 while closed
+    Cell *m_cells;
+    quint32 m_mask;
+    QAtomicInteger<quint32> m_enqueuePos;
+    QAtomicInteger<quint32> m_dequeuePos;
+    QAtomicInt m_dropped;
+    QAtomicInt m_stopping;
+
+    // methods
+    bool enqueue(const QByteArray &data);
+    bool dequeue(QByteArray &data);
+    bool writeNextRaw(int fd);
+    void openFile();
+    void closeFile();
+    bool drain();
+    void rotate();
+};
+
+#endif // LOGGER_H
@@ -0,0 +1,42 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "logging.h"
+
+Q_LOGGING_CATEGORY(lcApp, "popcorn.app")
+Q_LOGGING_CATEGORY(lcNet, "popcorn.net")
+Q_LOGGING_CATEGORY(lcUdp, "popcorn.udp")
+Q_LOGGING_CATEGORY(lcDb, "popcorn.db")
+Q_LOGGING_CATEGORY(lcFs, "popcorn.fs")
+Q_LOGGING_CATEGORY(lcJs, "popcorn.js")
+
+QAtomicInt log_threshold(-1);
+
+/* rules are QLoggingCategory filter rules separated by ';' or newlines,
+ * e.g. "popcorn.*=false;popcorn.db=true". Empty rules enable all popcorn
+ * categories. threshold replaces log_threshold unless it is below -1.
+ */
+void setLogRules(QString rules, int threshold) {
+    if (rules == "") rules = "popcorn.*.debug=true";
+    QLoggingCategory::setFilterRules(rules.replace(";", "\n"));
+    if (threshold >= -1) log_threshold = threshold;
+}
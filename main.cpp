@@ -23,13 +23,23 @@
 #include <QSettings>
 #include <QDebug>
 #include <QCommandLineParser>
+#include <QStandardPaths>
 
 #include "mainwindow.h"
+#include "logger.h"
+#include "logging.h"
+#include "settingsbuffer.h"
+#include "startuptrace.h"
+#include "assetbundle.h"
+
+#include <signal.h>
 
 QSettings *settings;
+SettingsBuffer *settings_buffer;
 QString application_path;
 QString home_path;
 QString jail_working_path;
+QString data_path;
 
 
 #ifdef Q_OS_LINUX
@@ -38,50 +48,38 @@ Display *display;
 
 
 void logToFile(QtMsgType type, const QMessageLogContext &context, const QString &msg) {
-    QString pathLog = home_path + "/" APPNAME ".log";
-    QFile f(pathLog);
-    f.open(QIODevice::Append);
-    QDateTime datetime = QDateTime::currentDateTime();
-    QString timestamp = datetime.toString("yyyyMMddHHmmss");
-    f.write(timestamp.toLatin1());
-    f.write(" ");
-    f.write(QString(msg).toLatin1());
-    f.write("\r\n");
-    f.close();
+    Logger *logger = Logger::instance();
+    logger->log(msg);
+    if (type == QtFatalMsg) {
+        // Qt aborts after this handler returns
+        logger->stop();
+    }
 }
 
 
-void logToStdout(QtMsgType type, const QMessageLogContext &context, const QString &msg) {
-    QByteArray localMsg = QString(msg).toLocal8Bit();
+void crashHandler(int sig) {
+    signal(sig, SIG_DFL);
+    Logger::flushOnCrash();
+    raise(sig);
+}
 
-    int threshold = settings->value("log_threshold").toInt();
-    int level;
 
-    if (localMsg.startsWith("Level")) {
-        level = localMsg.mid(5, 1).toInt();
-        if (level <= threshold) {
-            printf("%s\n", localMsg.constData());
-            fflush(stdout);
-        }
-        return;
-    }
+void logToStdout(QtMsgType type, const QMessageLogContext &context, const QString &msg) {
+    // levels and categories are filtered before formatting, see logging.h
+    QByteArray localMsg = QString(msg).toLocal8Bit();
+    printf("%s\n", localMsg.constData());
+    fflush(stdout);
 }
 
 
 void noLog(QtMsgType type, const QMessageLogContext &context, const QString &msg) {
 }
 
-void purgeLogfile() {
-    qDebug() << "Truncating Logfile";
-    QString pathLog = home_path + "/" APPNAME ".log";
-    QFile f(pathLog);
-    f.open(QFile::WriteOnly|QFile::Truncate);
-    f.close();
-}
-
-
 int main(int argc, char *argv[]) {
+    StartupTrace::start();
+    StartupTrace::begin("QApplication");
     QApplication a(argc, argv);
+    StartupTrace::end("QApplication");
     QApplication::setApplicationName("popcorn");
     QApplication::setApplicationVersion(QString::number(VERSION_MAJOR) + "." + QString::number(VERSION_MINOR) + "." + QString::number(VERSION_PATCH));
 
@@ -92,24 +90,46 @@ int main(int argc, char *argv[]) {
 #endif
     QDir().mkpath(home_path);
 
+    // private to the application: not reachable through any jail
+    data_path = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/";
+    QDir().mkpath(data_path);
+
     QCommandLineOption ini_file_option("c", "Configuration file to use", "ini_file", home_path + APPNAME ".ini");
     QCommandLineOption development_option("d", "Development. Boot from ./assets/index.html");
+    QCommandLineOption pack_option("p", "Pack an assets directory into assets.pcab next to it and exit", "assets_dir");
+    QCommandLineOption trace_option("t", "Write a startup trace (Chrome trace format) to the home directory");
 
     QCommandLineParser parser;
     parser.addHelpOption();
     parser.addVersionOption();
     parser.addOption(ini_file_option);
     parser.addOption(development_option);
+    parser.addOption(trace_option);
+    parser.addOption(pack_option);
     parser.process(a);
 
+    if (parser.isSet(pack_option)) {
+        QDir assets_dir(parser.value(pack_option));
+        QString bundle_abs = QFileInfo(assets_dir.absolutePath()).absolutePath() + "/assets.pcab";
+        QString error;
+        if (!AssetBundle::pack(assets_dir.absolutePath(), bundle_abs, &error)) {
+            printf("Packing %s failed: %s\n", qPrintable(assets_dir.absolutePath()), qPrintable(error));
+            return 1;
+        }
+        printf("Wrote %s (version %s)\n", qPrintable(bundle_abs), qPrintable(AssetBundle::readVersion(bundle_abs)));
+        return 0;
+    }
+
 #ifdef Q_OS_LINUX
     display = XOpenDisplay(NULL);
 #endif
 
     application_path = QFileInfo(QCoreApplication::applicationFilePath()).canonicalPath() + "/";
 
+    StartupTrace::begin("settings");
     QString ini_file = parser.value(ini_file_option);
     settings = new QSettings(ini_file, QSettings::IniFormat);
+    settings_buffer = new SettingsBuffer(settings);
     qDebug() << "[main]: ini file is" << settings->fileName();
 
     QString filespath = QDir::homePath() + "/" APPNAME "-files/";
@@ -122,7 +142,16 @@ int main(int argc, char *argv[]) {
     if (!settings->contains("log_to_stdout"))   settings->setValue("log_to_stdout", "false");
     if (!settings->contains("context_menu"))    settings->setValue("context_menu", "true");
     if (!settings->contains("log_threshold"))   settings->setValue("log_threshold", 0);
+    if (!settings->contains("startup_trace"))   settings->setValue("startup_trace", "false");
+    if (!settings->contains("log_rules"))       settings->setValue("log_rules", "");
+    if (!settings->contains("log_max_size"))    settings->setValue("log_max_size", 10485760);
     if (!settings->contains("url"))             settings->setValue("url", "");
+    if (!settings->contains("db_profile"))      settings->setValue("db_profile", "default");
+    if (!settings->contains("db_slow_query_ms")) settings->setValue("db_slow_query_ms", 100);
+    if (!settings->contains("wire_format"))     settings->setValue("wire_format", "qdatastream");
+
+    StartupTrace::end("settings");
+    StartupTrace::setEnabled(parser.isSet(trace_option) || settings->value("startup_trace").toString() == "true", home_path + "startup_trace.json");
 
     jail_working_path = settings->value("jail_working").toString();
 
@@ -133,22 +162,39 @@ int main(int argc, char *argv[]) {
         settings->setValue("jail_working", jail_working_path);
     }
 
-    purgeLogfile();
-
+    StartupTrace::begin("logging");
     if (settings->value("log_to_file").toString() == "true") {
+        Logger::start(home_path + "/" APPNAME ".log", settings->value("log_max_size").toLongLong());
+        signal(SIGSEGV, crashHandler);
+        signal(SIGABRT, crashHandler);
+        signal(SIGFPE, crashHandler);
+        signal(SIGILL, crashHandler);
         qInstallMessageHandler(logToFile);
+        setLogRules(settings->value("log_rules").toString(), 9); // all levels, as before
     } else if (settings->value("log_to_stdout").toString() == "true") {
         qInstallMessageHandler(logToStdout);
+        setLogRules(settings->value("log_rules").toString(), settings->value("log_threshold").toInt());
     } else {
         qDebug() << "[main]: Logging disabled. Enable log_to_file or log_to_stdout in ini file.";
         qInstallMessageHandler(noLog);
+        setLogRules("popcorn.*=false", -1);
     }
+    StartupTrace::end("logging");
 
     settings->setValue("exit", "false"); // this tells us if the program has crashed or exited normally
 
-    MainWindow w;
-    w.init(parser.isSet(development_option));
-    w.show();
+    int result;
+    {
+        // scoped, so that the window is torn down while the logger still runs
+        MainWindow w;
+        w.init(parser.isSet(development_option));
+        w.show();
 
-    return a.exec();
+        StartupTrace::mark("event loop");
+        result = a.exec();
+        StartupTrace::write();
+    }
+    settings_buffer->sync();
+    if (Logger::instance()) Logger::instance()->stop();
+    return result;
 }
@@ -22,58 +22,71 @@
 
 
 #include "mainwindow.h"
+#include "logging.h"
+#include "settingsbuffer.h"
+#include "startuptrace.h"
+#include "fileutil.h"
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
 {
     m_version = QString::number(VERSION_MAJOR) + "." + QString::number(VERSION_MINOR) + "." + QString::number(VERSION_PATCH);
+    m_jsApi = NULL;
+    m_trayIcon = NULL;
+    m_optionsDialog = NULL;
+    m_inspector = NULL;
 }
 
 MainWindow::~MainWindow() {
-    qDebug() << "Level0 [MainWindow::~MainWindow] Called";
+    PLOG(lcApp, 0) << "[MainWindow::~MainWindow] Called";
     if (windowState().testFlag(Qt::WindowMinimized) == true) {
-        settings->setValue("minified_state", "true");
+        settings_buffer->setValue("minified_state", "true");
     } else {
-        settings->setValue("minified_state", "false");
+        settings_buffer->setValue("minified_state", "false");
     }
-    settings->setValue("exit", "true");
-    settings->sync();
+    settings_buffer->setValue("exit", "true");
+    settings_buffer->sync();
 
-    qDebug() << "Level0 [MainWindow::~MainWindow] Done";
+    PLOG(lcApp, 0) << "[MainWindow::~MainWindow] Done";
 }
 
 void MainWindow::init(bool is_development) {
     //qApp->installEventFilter(this);
+    StartupTrace::Scope trace("MainWindow::init");
   
-    setWindowTitle(settings->value("window_title").toString());
+    setWindowTitle(settings_buffer->value("window_title").toString());
 
-    if (settings->value("minified_state").toString() == "true") {
+    if (settings_buffer->value("minified_state").toString() == "true") {
         setWindowState(Qt::WindowMinimized);
     }
 
     this->setMinimumWidth(430);
     this->setMinimumHeight(430);
 
+    StartupTrace::begin("webview");
     webView = new QWebView(this);
-    if (settings->value("context_menu").toString() == "false") {
+    if (settings_buffer->value("context_menu").toString() == "false") {
         webView->setContextMenuPolicy(Qt::NoContextMenu);
     }
     this->setCentralWidget(webView);
 
-    m_network_manager = new QNetworkAccessManager(this);
+    m_network_manager = new AssetNetworkManager(this);
+    if (!is_development) openAssetBundle();
 
     QWebPage *webPage = webView->page();
     webPage->setNetworkAccessManager(m_network_manager);
     webPage->setLinkDelegationPolicy(QWebPage::DelegateAllLinks);
     connect(webPage, &QWebPage::linkClicked, this, &MainWindow::onLinkClicked);
     connect(webPage->mainFrame(), &QWebFrame::javaScriptWindowObjectCleared, this, &MainWindow::attachJsApi);
+    connect(webView, &QWebView::loadFinished, this, &MainWindow::onLoadFinished);
 
     webView->show();
+    StartupTrace::end("webview");
 
     bootstrap(is_development);
 
     // restore saved window geometry from .ini file
-    QVariant size = settings->value("main_window_geometry");
+    QVariant size = settings_buffer->value("main_window_geometry");
     if ( size.isNull() ) {
         this->setGeometry(QRect(500, 100, 700, 500));
     } else {
@@ -81,14 +94,12 @@ void MainWindow::init(bool is_development) {
     }
 
     // restore saved zoom factor from .ini file
-    qreal z = settings->value("zoom_factor").toReal();
+    qreal z = settings_buffer->value("zoom_factor").toReal();
     if ( z ) webView->page()->mainFrame()->setZoomFactor(z);
 
+    StartupTrace::begin("JsApi");
     m_jsApi = new JsApi(this);
-
-    optionsDialog = new OptionsDialog(this);
-    optionsDialog->m_version = m_version;
-    connect(optionsDialog, SIGNAL(accepting()), m_jsApi, SLOT(onOptionsDialogAccepted()));
+    StartupTrace::end("JsApi");
 
     QShortcut *zoomin = new QShortcut(QKeySequence(Qt::CTRL + Qt::Key_Plus), this);
     connect(zoomin, &QShortcut::activated, this, &MainWindow::onZoomIn);
@@ -101,47 +112,163 @@ void MainWindow::init(bool is_development) {
 
     QWebSettings::setObjectCacheCapacities(0, 0, 0);
 
-    if (settings->value("webinspector").toString() == "true") {
+    if (settings_buffer->value("webinspector").toString() == "true") {
+        // the inspector itself is created when the first page has loaded
         QWebSettings::globalSettings()->setAttribute(QWebSettings::DeveloperExtrasEnabled, true);
+    }
+
+    // once the event loop runs, i.e. after the window is shown
+    QTimer::singleShot(0, this, SLOT(initTrayIcon()));
+}
+
+QSystemTrayIcon *MainWindow::trayIcon() {
+    if (!m_trayIcon) {
+        StartupTrace::Scope trace("trayIcon");
+        QIcon icon = QIcon(application_path + "/" + APPNAME + ".png");
+        m_trayIcon = new QSystemTrayIcon(this);
+        m_trayIcon->setIcon(icon);
+        m_trayIcon->show();
+        connect(m_trayIcon, &QSystemTrayIcon::messageClicked, m_jsApi, &JsApi::onTrayMessageClicked);
+        connect(m_trayIcon, &QSystemTrayIcon::activated, m_jsApi, &JsApi::onTrayIconActivated);
+    }
+    return m_trayIcon;
+}
+
+void MainWindow::initTrayIcon() {
+    trayIcon();
+}
+
+OptionsDialog *MainWindow::optionsDialog() {
+    if (!m_optionsDialog) {
+        m_optionsDialog = new OptionsDialog(this);
+        m_optionsDialog->m_version = m_version;
+        connect(m_optionsDialog, SIGNAL(accepting()), m_jsApi, SLOT(onOptionsDialogAccepted()));
+    }
+    return m_optionsDialog;
+}
+
+AssetBundle *MainWindow::assetBundle() {
+    return m_network_manager->bundle();
+}
 
-        QWebInspector *inspector;
-        inspector = new QWebInspector();
-        inspector->setPage(webView->page());
-        inspector->setGeometry(QRect(500, 10, 1000, 700));
-        inspector->show();
+/* An upgraded bundle is delivered as assets.pcab in the working jail
+ * (written as .part and renamed, like all downloads) and is installed on
+ * the next start by moving it to data_path, before any Javascript runs.
+ * The mapped bundle is therefore never a file that Javascript or a
+ * Client receive can write in place, which would serve torn assets or
+ * raise SIGBUS. A bundle that fails to open (e.g. an incomplete upload)
+ * or is not newer than the installed and application ones is left where
+ * it is.
+ */
+void MainWindow::installAssetBundle() {
+    QString upload_abs = jail_working_path + "assets.pcab";
+    QString installed_abs = data_path + "assets.pcab";
+    if (!QFile::exists(upload_abs)) return;
+    {
+        AssetBundle check;
+        if (!check.open(upload_abs)) {
+            PLOG(lcApp, 0) << "[MainWindow::installAssetBundle] Not a valid bundle, ignoring" << upload_abs;
+            return;
+        }
+        // an upgrade must be newer than what is already there
+        QString current = AssetBundle::readVersion(installed_abs);
+        QString application = AssetBundle::readVersion(application_path + "assets.pcab");
+        if (AssetBundle::compareVersions(current, application) < 0) current = application;
+        if (current != "" && AssetBundle::compareVersions(check.version(), current) <= 0) {
+            PLOG(lcApp, 0) << "[MainWindow::installAssetBundle] Not newer than" << current << ", ignoring" << upload_abs << check.version();
+            return;
+        }
     }
+    QFile::remove(installed_abs);
+    bool success = QFile::rename(upload_abs, installed_abs);
+    if (!success) {
+        // e.g. another file system: copy, then replace atomically
+        QString part_abs = installed_abs + ".part";
+        QFile::remove(part_abs);
+        success = FileUtil::copyFile(upload_abs, part_abs) && QFile::rename(part_abs, installed_abs);
+        if (success) {
+            QFile::remove(upload_abs);
+        } else {
+            QFile::remove(part_abs);
+        }
+    }
+    PLOG(lcApp, 0) << "[MainWindow::installAssetBundle]" << upload_abs << "to" << installed_abs << success;
+}
 
-    QIcon icon = QIcon(application_path + "/" + APPNAME + ".png");
-    m_trayIcon = new QSystemTrayIcon(this);
-    m_trayIcon->setIcon(icon);
-    m_trayIcon->show();
-    connect(m_trayIcon, &QSystemTrayIcon::messageClicked, m_jsApi, &JsApi::onTrayMessageClicked);
-    connect(m_trayIcon, &QSystemTrayIcon::activated, m_jsApi, &JsApi::onTrayIconActivated);
+/* Uses the newer of the installed bundle and the one in the application
+ * directory, the installed one on a tie since it is where upgrades go.
+ */
+void MainWindow::openAssetBundle() {
+    StartupTrace::Scope trace("openAssetBundle");
+    installAssetBundle();
+    QString installed_abs = data_path + "assets.pcab";
+    QString application_abs = application_path + "assets.pcab";
+    QString installed_version = AssetBundle::readVersion(installed_abs);
+    QString application_version = AssetBundle::readVersion(application_abs);
+    PLOG(lcApp, 1) << "[MainWindow::openAssetBundle] installed" << installed_version << "application" << application_version;
+
+    QString chosen;
+    if (installed_version != "" && AssetBundle::compareVersions(installed_version, application_version) >= 0) {
+        chosen = installed_abs;
+    } else if (application_version != "") {
+        chosen = application_abs;
+    } else {
+        return;
+    }
+
+    AssetBundle *bundle = new AssetBundle();
+    if (!bundle->open(chosen)) {
+        PLOG(lcApp, 0) << "[MainWindow::openAssetBundle] Cannot open" << chosen;
+        delete bundle;
+        return;
+    }
+    QWebSecurityOrigin::addLocalScheme("popcorn");
+    m_network_manager->setBundle(bundle);
+    PLOG(lcApp, 0) << "[MainWindow::openAssetBundle] Serving assets from" << chosen << bundle->version();
+}
+
+/* The trace is complete once the application page (rather than the boot
+ * page) has loaded.
+ */
+void MainWindow::onLoadFinished(bool ok) {
+    QString page = webView->url().fileName();
+    PLOG(lcApp, 1) << "[MainWindow::onLoadFinished]" << page << ok;
+    StartupTrace::mark("loadFinished " + page);
+    if (page != "boot.html") StartupTrace::write();
+
+    if (!m_inspector && settings_buffer->value("webinspector").toString() == "true") {
+        m_inspector = new QWebInspector();
+        m_inspector->setPage(webView->page());
+        m_inspector->setGeometry(QRect(500, 10, 1000, 700));
+        m_inspector->show();
+    }
 }
 
 
 
 void MainWindow::bootstrap(bool is_development) {
+    StartupTrace::Scope trace("bootstrap");
     QString index_file_chosen;
 
     if ( is_development ) {
         // given on command line has highest priority
         index_file_chosen = "file:///" + application_path + "assets/index.html";
 
-    } else if (settings->value("url").toString() != "") {
-        index_file_chosen = settings->value("url").toString();
+    } else if (settings_buffer->value("url").toString() != "") {
+        index_file_chosen = settings_buffer->value("url").toString();
 
     } else {
         index_file_chosen = "file:///" + application_path + "boot.html";
     }
 
-    qDebug() << "Level0 [MainWindow::bootstrap] Navigating to" << index_file_chosen;
+    PLOG(lcApp, 0) << "[MainWindow::bootstrap] Navigating to" << index_file_chosen;
     webView->load(QUrl(index_file_chosen));
 }
 
 
 void MainWindow::attachJsApi() {
-    qDebug() << "Level1 [MainWindow::attachJsApi] Exposing the jsApi class to Javascript.";
+    PLOG(lcApp, 1) << "[MainWindow::attachJsApi] Exposing the jsApi class to Javascript.";
+    StartupTrace::mark("attachJsApi");
     webView->page()->mainFrame()->addToJavaScriptWindowObject("API", m_jsApi);
 }
 
@@ -151,31 +278,31 @@ void MainWindow::onLinkClicked(QUrl url) {
 
 
 void MainWindow::resizeEvent(QResizeEvent *event) {
-    qDebug() << "Level1 [MainWindow::resizeEvent] Saving MainWindow geometry" << this->geometry();
+    PLOG(lcApp, 1) << "[MainWindow::resizeEvent] Saving MainWindow geometry" << this->geometry();
     QVariant geometry = this->geometry();
-    settings->setValue("main_window_geometry", geometry);
+    settings_buffer->setValue("main_window_geometry", geometry);
     QWidget::resizeEvent(event);
 }
 
 void MainWindow::moveEvent(QMoveEvent *event) {
-    qDebug() << "Level1 [MainWindow::moveEvent] Saving MainWindow geometry" << this->geometry();
+    PLOG(lcApp, 1) << "[MainWindow::moveEvent] Saving MainWindow geometry" << this->geometry();
     QVariant geometry = this->geometry();
-    settings->setValue("main_window_geometry", geometry);
+    settings_buffer->setValue("main_window_geometry", geometry);
     QWidget::moveEvent(event);
 }
 
 void MainWindow::onZoomIn() {
-    qDebug() << "Level1 [MainWindow::onZoomIn]";
+    PLOG(lcApp, 1) << "[MainWindow::onZoomIn]";
     qreal z = webView->page()->mainFrame()->zoomFactor();
     z = z + 0.05;
     webView->page()->mainFrame()->setZoomFactor(z);
-    settings->setValue("zoom_factor", z);
+    settings_buffer->setValue("zoom_factor", z);
 }
 
 void MainWindow::onZoomOut() {
-    qDebug() << "Level1 [MainWindow::onZoomOut]";
+    PLOG(lcApp, 1) << "[MainWindow::onZoomOut]";
     qreal z = webView->page()->mainFrame()->zoomFactor();
     z = z - 0.05;
     webView->page()->mainFrame()->setZoomFactor(z);
-    settings->setValue("zoom_factor", z);
+    settings_buffer->setValue("zoom_factor", z);
 }
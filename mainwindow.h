@@ -39,10 +39,13 @@
 extern QSettings *settings;
 extern QString application_path;
 extern QString home_path;
+extern QString jail_working_path;
+extern QString data_path;
 
 
 #include "jsapi.h"
 #include "optionsdialog.h"
+#include "assetbundle.h"
 
 #define APPNAME "popcorn"
 #define VERSION_MAJOR 0
@@ -65,17 +68,30 @@ public:
     void moveEvent(QMoveEvent *event);
     void bootstrap(bool is_development);
 
+    // created on first use, to keep them off the startup path
+    QSystemTrayIcon *trayIcon();
+    OptionsDialog *optionsDialog();
+    AssetBundle *assetBundle();
+
     //variables
     QWebView * webView;
-    QSystemTrayIcon * m_trayIcon;
-    OptionsDialog * optionsDialog;
     QString m_version;
-    QNetworkAccessManager * m_network_manager;
+    AssetNetworkManager * m_network_manager;
 
 
 private:
     // class member variables
     JsApi *m_jsApi;
+    QSystemTrayIcon *m_trayIcon;
+    OptionsDialog *m_optionsDialog;
+    QWebInspector *m_inspector;
+
+    void installAssetBundle();
+    void openAssetBundle();
+
+private slots:
+    void initTrayIcon();
+    void onLoadFinished(bool ok);
 
 
 public slots:
@@ -21,6 +21,8 @@
  */
 
 #include "optionsdialog.h"
+#include "logging.h"
+#include "settingsbuffer.h"
 #include "ui_optionsdialog.h"
 #include <QCheckBox>
 
@@ -39,16 +41,17 @@ OptionsDialog::~OptionsDialog()
 void OptionsDialog::loadSettings() {
     ui->labelVersion->setText(m_version);
     ui->jailWorkingInput->setText(jail_working_path);
-    ui->limitFileReadingCheckBox->setChecked(settings->value("fileread_jailed").toString() == "true");
+    ui->limitFileReadingCheckBox->setChecked(settings_buffer->value("fileread_jailed").toString() == "true");
     ui->labelIniFile->setText(settings->fileName());
-    ui->urlInput->setText(settings->value("url").toString());
+    ui->urlInput->setText(settings_buffer->value("url").toString());
 }
 
 void OptionsDialog::accept() {
-    qDebug() << "[OptionsDialog::accept]";
-    settings->setValue("jail_working", ui->jailWorkingInput->text());
-    settings->setValue("fileread_jailed", ui->limitFileReadingCheckBox->isChecked());
-    settings->setValue("url", ui->urlInput->text());
+    PLOG(lcApp, 1) << "[OptionsDialog::accept]";
+    settings_buffer->setValue("jail_working", ui->jailWorkingInput->text());
+    settings_buffer->setValue("fileread_jailed", ui->limitFileReadingCheckBox->isChecked());
+    settings_buffer->setValue("url", ui->urlInput->text());
+    settings_buffer->sync();
 
     emit accepting();
     close();
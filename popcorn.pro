@@ -3,7 +3,7 @@ QT       += core gui network webkit sql
 }
 
 equals(QT_MAJOR_VERSION, 5) {
-QT       += core gui network webkit sql widgets webkitwidgets multimedia
+QT       += core gui network webkit sql widgets webkitwidgets multimedia concurrent
 }
 
 macx {
@@ -29,6 +29,25 @@ SOURCES += main.cpp\
     optionsdialog.cpp \
     downloader.cpp \
     database.cpp \
+    database_worker.cpp \
+    retention.cpp \
+    querystats.cpp \
+    hashjob.cpp \
+    xxhash64.cpp \
+    fileutil.cpp \
+    contentstore.cpp \
+    dircopier.cpp \
+    filehandle.cpp \
+    dirwatcher.cpp \
+    fileopjob.cpp \
+    unzipper.cpp \
+    dirstream.cpp \
+    codec.cpp \
+    logger.cpp \
+    logging.cpp \
+    settingsbuffer.cpp \
+    startuptrace.cpp \
+    assetbundle.cpp \
     randomng.c \
     tcpserver.cpp \
     udpserver.cpp
@@ -40,6 +59,25 @@ HEADERS  += \
     optionsdialog.h \
     downloader.h \
     database.h \
+    database_worker.h \
+    retention.h \
+    querystats.h \
+    hashjob.h \
+    xxhash64.h \
+    fileutil.h \
+    contentstore.h \
+    dircopier.h \
+    filehandle.h \
+    dirwatcher.h \
+    fileopjob.h \
+    unzipper.h \
+    dirstream.h \
+    codec.h \
+    logger.h \
+    logging.h \
+    settingsbuffer.h \
+    startuptrace.h \
+    assetbundle.h \
     process_manager.h \
     tcpserver.h \
     udpserver.h
@@ -52,6 +90,10 @@ linux-g++* {
   LIBS += -L/usr/include/X11 -L/usr/include/X11/extensions -lXss -lX11
 }
 
+unix {
+  LIBS += -lz
+}
+
 win32 {
     LIBS += -lpsapi
 }
@@ -21,11 +21,12 @@
  */
 
 #include "process_manager.h"
+#include "logging.h"
 
 ProcessManager::ProcessManager(QObject *parent, QString app, QStringList args, bool detach, QString working_dir, qint64 timeout) :
     QObject(parent)
 {
-    qDebug() << "Level1 [ProcessManager::initialize]" << app << args << detach << working_dir << timeout;
+    PLOG(lcApp, 1) << "[ProcessManager::initialize]" << app << args << detach << working_dir << timeout;
 
     m_app = app;
     m_args = args;
@@ -46,11 +47,11 @@ ProcessManager::ProcessManager(QObject *parent, QString app, QStringList args, b
     connect(m_proc, SIGNAL(readyReadStandardOutput()), this, SLOT(onReadyReadStandardOutput()));
     connect(m_proc, SIGNAL(error(QProcess::ProcessError)), this, SLOT(onError(QProcess::ProcessError)));
 
-    qDebug() << "Level1 [ProcessManager::initialize ]done";
+    PLOG(lcApp, 1) << "[ProcessManager::initialize ]done";
 }
 
 void ProcessManager::run() {
-    qDebug() << "Level1 [ProcessManager::run]";
+    PLOG(lcApp, 1) << "[ProcessManager::run]";
     if (m_detach) {
         m_proc->startDetached(m_app, m_args);
     } else {
@@ -59,28 +60,28 @@ void ProcessManager::run() {
 }
 
 void ProcessManager::onFinished(int exitCode, QProcess::ExitStatus exitStatus) {
-    qDebug() << "Level0 [ProcessManager::onFinished]" << exitCode << exitStatus;
+    PLOG(lcApp, 0) << "[ProcessManager::onFinished]" << exitCode << exitStatus;
     QVariantMap std_in_out;
     std_in_out.insert("stdout", m_buffer_stdout);
     std_in_out.insert("stderr", m_buffer_stderr);
     emit finished(std_in_out);
     m_proc->deleteLater();
-    qDebug() << "Level1 [ProcessManager::onFinished] cleaned up";
+    PLOG(lcApp, 1) << "[ProcessManager::onFinished] cleaned up";
 }
 
 void ProcessManager::onError(QProcess::ProcessError err) {
-    qDebug() << "Level0 [ProcessManager::error]" << err;
+    PLOG(lcApp, 0) << "[ProcessManager::error]" << err;
     emit error(err);
 }
 
 void ProcessManager::onReadyReadStandardError () {
     QString output = QString::fromUtf8(m_proc->readAllStandardError());
     m_buffer_stderr.append(output);
-    qDebug() << "Level1 [ProcessManager::readyReadStandardError]" << output;
+    PLOG(lcApp, 1) << "[ProcessManager::readyReadStandardError]" << output;
 }
 
 void ProcessManager::onReadyReadStandardOutput () {
     QString output = QString::fromUtf8(m_proc->readAllStandardOutput());
     m_buffer_stdout.append(output);
-    qDebug() << "Level1 [ProcessManager::readyReadStandardOutput]" << output;
+    PLOG(lcApp, 1) << "[ProcessManager::readyReadStandardOutput]" << output;
 }
@@ -0,0 +1,150 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "querystats.h"
+#include "logging.h"
+
+#include <QMutexLocker>
+#include <QDateTime>
+#include <QRegExp>
+#include <QDebug>
+
+#include <algorithm>
+
+#define QUERYSTATS_SAMPLES 512
+#define QUERYSTATS_SLOW_LOG 100
+#define QUERYSTATS_MAX_ENTRIES 500
+#define QUERYSTATS_MAX_KEYS 2000
+#define QUERYSTATS_OTHER "(other)"
+
+QueryStats::QueryStats(int slow_threshold_ms) {
+    m_slow_threshold_nsecs = (qint64)slow_threshold_ms * 1000000;
+}
+
+QString QueryStats::normalize(QString statement) {
+    QString s = statement.trimmed();
+    s.replace(QRegExp("'([^']|'')*'"), "?");
+    s.replace(QRegExp("\\b\\d+(\\.\\d+)?\\b"), "?");
+    s.replace(QRegExp("\\s+"), " ");
+    s.replace(QRegExp("\\(\\s*\\?(\\s*,\\s*\\?)*\\s*\\)"), "(?)");
+    return s;
+}
+
+bool QueryStats::isSlow(qint64 nsecs) {
+    QMutexLocker locker(&m_mutex);
+    return nsecs >= m_slow_threshold_nsecs;
+}
+
+void QueryStats::setSlowThreshold(int ms) {
+    QMutexLocker locker(&m_mutex);
+    m_slow_threshold_nsecs = (qint64)ms * 1000000;
+}
+
+/* Runs for every executed statement, including every row of a batch, so
+ * the regex normalization is done once per distinct statement text.
+ */
+void QueryStats::record(QString statement, qint64 nsecs, QVariantList plan) {
+    QMutexLocker locker(&m_mutex);
+    QString key = m_keys.value(statement);
+    if (key.isNull()) {
+        locker.unlock();
+        key = normalize(statement);
+        locker.relock();
+        // ad-hoc SQL with inlined literals would grow the cache forever
+        if (m_keys.size() >= QUERYSTATS_MAX_KEYS) m_keys.clear();
+        m_keys.insert(statement, key);
+    }
+    if (!m_entries.contains(key) && m_entries.size() >= QUERYSTATS_MAX_ENTRIES) {
+        key = QUERYSTATS_OTHER;
+    }
+
+    Entry &entry = m_entries[key];
+    if (entry.samples.isEmpty()) {
+        entry.count = 0;
+        entry.total_nsecs = 0;
+        entry.max_nsecs = 0;
+        entry.next_sample = 0;
+        entry.samples.reserve(QUERYSTATS_SAMPLES);
+    }
+    entry.count++;
+    entry.total_nsecs += nsecs;
+    if (nsecs > entry.max_nsecs) entry.max_nsecs = nsecs;
+    if (entry.samples.size() < QUERYSTATS_SAMPLES) {
+        entry.samples.append(nsecs);
+    } else {
+        entry.samples[entry.next_sample] = nsecs;
+        entry.next_sample = (entry.next_sample + 1) % QUERYSTATS_SAMPLES;
+    }
+
+    if (nsecs >= m_slow_threshold_nsecs) {
+        QVariantMap slow;
+        slow.insert("query", statement);
+        slow.insert("ms", nsecs / 1000000.0);
+        slow.insert("plan", plan);
+        slow.insert("time", QDateTime::currentDateTime().toString("yyyyMMddHHmmss"));
+        m_slow.append(slow);
+        if (m_slow.length() > QUERYSTATS_SLOW_LOG) m_slow.removeFirst();
+        PLOG(lcDb, 0) << "[QueryStats::record] slow query" << nsecs / 1000000.0 << "ms" << statement << plan;
+    }
+}
+
+void QueryStats::reset() {
+    QMutexLocker locker(&m_mutex);
+    m_entries.clear();
+    m_keys.clear();
+    m_slow.clear();
+}
+
+/* Returns count, total, mean, p50, p99 and max latency in ms, keyed by
+ * normalized statement. Percentiles are computed over the most recent
+ * QUERYSTATS_SAMPLES executions.
+ */
+QVariantMap QueryStats::stats() {
+    QMutexLocker locker(&m_mutex);
+    QVariantMap result;
+    QMapIterator<QString, Entry> it(m_entries);
+    while (it.hasNext()) {
+        it.next();
+        const Entry &entry = it.value();
+        QVector<qint64> sorted = entry.samples;
+        std::sort(sorted.begin(), sorted.end());
+
+        QVariantMap map;
+        map.insert("count", entry.count);
+        map.insert("total_ms", entry.total_nsecs / 1000000.0);
+        map.insert("mean_ms", entry.total_nsecs / 1000000.0 / entry.count);
+        map.insert("p50_ms", sorted.at((sorted.size() - 1) * 50 / 100) / 1000000.0);
+        map.insert("p99_ms", sorted.at((sorted.size() - 1) * 99 / 100) / 1000000.0);
+        map.insert("max_ms", entry.max_nsecs / 1000000.0);
+        result.insert(it.key(), map);
+    }
+    return result;
+}
+
+QVariantList QueryStats::slowQueries() {
+    QMutexLocker locker(&m_mutex);
+    QVariantList list;
+    foreach (QVariantMap slow, m_slow) {
+        list.append(slow);
+    }
+    return list;
+}
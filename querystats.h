@@ -0,0 +1,73 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef QUERYSTATS_H
+#define QUERYSTATS_H
+
+#include <QMutex>
+#include <QMap>
+#include <QHash>
+#include <QList>
+#include <QVector>
+#include <QVariantMap>
+#include <QStringList>
+
+/* Collects per-statement timings of one Database and its worker
+ * connections. Statements are grouped by their normalized text, in which
+ * literals are replaced by '?'. Statements slower than the threshold are
+ * kept in a bounded slow-query log together with their query plan.
+ * Normalized keys are cached per raw statement text, and the number of
+ * distinct statements is bounded; beyond that, timings are collected
+ * under "(other)".
+ * All methods are thread-safe.
+ */
+class QueryStats
+{
+public:
+    explicit QueryStats(int slow_threshold_ms = 100);
+
+    static QString normalize(QString statement);
+
+    bool isSlow(qint64 nsecs);
+    void record(QString statement, qint64 nsecs, QVariantList plan = QVariantList());
+    void setSlowThreshold(int ms);
+    void reset();
+    QVariantMap stats();
+    QVariantList slowQueries();
+
+private:
+    struct Entry {
+        qint64 count;
+        qint64 total_nsecs;
+        qint64 max_nsecs;
+        QVector<qint64> samples; // ring of the most recent timings
+        int next_sample;
+    };
+
+    QMutex m_mutex;
+    QMap<QString, Entry> m_entries;
+    QHash<QString, QString> m_keys; // raw statement -> normalized
+    QList<QVariantMap> m_slow;
+    qint64 m_slow_threshold_nsecs;
+};
+
+#endif // QUERYSTATS_H
@@ -0,0 +1,222 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "retention.h"
+#include "logging.h"
+#include "jsapi.h"
+
+#include <QDateTime>
+#include <QDebug>
+
+/* config keys:
+ *   table          history table (required)
+ *   time_column    column holding the message time (required)
+ *   time_unit      "s" (default) or "ms" since the epoch
+ *   max_age_days   rows older than this are moved out, 0 = no age limit
+ *   max_size_mb    oldest rows are moved out while the file is larger, 0 = no size limit
+ *   archive_path   archive file relative to the working directory, empty = delete rows
+ *   batch_size     rows per step, default 500
+ *   idle_seconds   only work when the user has been idle that long, default 60
+ *   interval_ms    time between steps, default 5000
+ *   vacuum_pages   pages returned to the file system per step, default 200
+ */
+Retention::Retention(JsApi *parent, Database *database, QVariantMap config) :
+    QObject(parent)
+{
+    PLOG(lcDb, 1) << "[Retention::Retention]" << config;
+    m_jsApi = parent;
+    m_database = database;
+
+    m_table = config.value("table").toString();
+    m_time_column = config.value("time_column").toString();
+    m_time_unit = config.value("time_unit", "s").toString();
+    m_max_age_days = config.value("max_age_days", 0).toDouble();
+    m_max_size_mb = config.value("max_size_mb", 0).toDouble();
+    m_archive_path = config.value("archive_path").toString();
+    m_batch_size = config.value("batch_size", 500).toInt();
+    m_idle_seconds = config.value("idle_seconds", 60).toDouble();
+    m_vacuum_pages = config.value("vacuum_pages", 200).toInt();
+
+    m_archive_attached = false;
+    m_total_moved = 0;
+
+    m_timer = new QTimer(this);
+    m_timer->setInterval(config.value("interval_ms", 5000).toInt());
+    connect(m_timer, &QTimer::timeout, this, &Retention::onTimeout);
+}
+
+Retention::~Retention() {
+    PLOG(lcDb, 1) << "[Retention::~Retention]" << m_table;
+}
+
+void Retention::start() {
+    PLOG(lcDb, 1) << "[Retention::start]" << m_table;
+    m_timer->start();
+}
+
+void Retention::stop() {
+    PLOG(lcDb, 1) << "[Retention::stop]" << m_table;
+    m_timer->stop();
+}
+
+void Retention::onTimeout() {
+    if (m_jsApi->getIdleTime() < m_idle_seconds) return;
+    QVariantMap info = step();
+    if (!info.value("success").toBool()) {
+        stop();
+        emit error(info.value("errors").toMap());
+        return;
+    }
+    emit progress(info);
+}
+
+qint64 Retention::pragmaValue(QString pragma) {
+    QVariantList view = m_database->run("PRAGMA " + pragma).value("view").toList();
+    if (view.isEmpty()) return -1;
+    QVariantMap row = view.first().toMap();
+    if (row.isEmpty()) return -1;
+    return row.values().first().toLongLong();
+}
+
+bool Retention::attachArchive() {
+    if (m_archive_attached || m_archive_path.isEmpty()) return true;
+    if (m_archive_path.contains("..")) return false;
+
+    QVariantList params;
+    params.append(jail_working_path + m_archive_path);
+    QVariantMap result = m_database->run("ATTACH DATABASE ? AS archive", params);
+    if (!result.value("success").toBool()) return false;
+
+    result = m_database->run(QString("CREATE TABLE IF NOT EXISTS archive.%1 AS SELECT * FROM main.%1 WHERE 0").arg(m_table));
+    if (!result.value("success").toBool()) return false;
+
+    m_archive_attached = true;
+    return true;
+}
+
+QVariantMap Retention::status() {
+    QVariantMap info;
+    if (!m_database) return info;
+    qint64 page_size = pragmaValue("page_size");
+    info.insert("size_bytes", pragmaValue("page_count") * page_size);
+    info.insert("free_bytes", pragmaValue("freelist_count") * page_size);
+    info.insert("auto_vacuum", pragmaValue("auto_vacuum"));
+    info.insert("total_moved", m_total_moved);
+    info.insert("running", m_timer->isActive());
+    return info;
+}
+
+/* Moves at most batch_size rows that are over the age limit, or the oldest
+ * rows if the file is over the size limit, in one transaction, then
+ * returns up to vacuum_pages free pages to the file system.
+ */
+QVariantMap Retention::step() {
+    QVariantMap info;
+    QVariantMap errors;
+
+    if (!m_database || !Database::isIdentifier(m_table) || !Database::isIdentifier(m_time_column)) {
+        errors.insert("db", "invalidConfiguration");
+        info.insert("success", false);
+        info.insert("errors", errors);
+        return info;
+    }
+
+    if (!attachArchive()) {
+        errors.insert("db", "cannotAttachArchive");
+        info.insert("success", false);
+        info.insert("errors", errors);
+        return info;
+    }
+
+    qint64 page_size = pragmaValue("page_size");
+    qint64 used_bytes = (pragmaValue("page_count") - pragmaValue("freelist_count")) * page_size;
+    bool over_size = m_max_size_mb > 0 && used_bytes > m_max_size_mb * 1024 * 1024;
+
+    QStringList conditions;
+    QVariantList condition_params;
+    if (!over_size) {
+        if (m_max_age_days <= 0) {
+            conditions.append("0");
+        } else {
+            qint64 cutoff = QDateTime::currentMSecsSinceEpoch() - (qint64)(m_max_age_days * 86400000);
+            if (m_time_unit != "ms") cutoff /= 1000;
+            conditions.append(m_time_column + " < ?");
+            condition_params.append(cutoff);
+        }
+    }
+    QString where = conditions.isEmpty() ? "" : "WHERE " + conditions.join(" AND ");
+
+    QStringList statements;
+    QVariantList params;
+    statements << "CREATE TEMP TABLE IF NOT EXISTS retention_ids (id INTEGER PRIMARY KEY)";
+    params << QVariant(QVariantList());
+    statements << "DELETE FROM temp.retention_ids";
+    params << QVariant(QVariantList());
+    statements << QString("INSERT INTO temp.retention_ids SELECT rowid FROM main.%1 %2 ORDER BY %3 LIMIT %4")
+                  .arg(m_table, where, m_time_column).arg(m_batch_size);
+    params << QVariant(condition_params);
+    if (!m_archive_path.isEmpty()) {
+        statements << QString("INSERT INTO archive.%1 SELECT * FROM main.%1 WHERE rowid IN (SELECT id FROM temp.retention_ids)").arg(m_table);
+        params << QVariant(QVariantList());
+    }
+    statements << QString("DELETE FROM main.%1 WHERE rowid IN (SELECT id FROM temp.retention_ids)").arg(m_table);
+    params << QVariant(QVariantList());
+
+    QVariantMap result = m_database->runBatch(statements, params);
+    if (!result.value("success").toBool()) {
+        info.insert("success", false);
+        info.insert("errors", result.value("errors"));
+        return info;
+    }
+
+    QVariantList view = m_database->run("SELECT count(*) AS n FROM temp.retention_ids").value("view").toList();
+    qint64 moved = view.isEmpty() ? 0 : view.first().toMap().value("n").toLongLong();
+    m_total_moved += moved;
+
+    // only has an effect with auto_vacuum=INCREMENTAL, see vacuum()
+    m_database->run(QString("PRAGMA incremental_vacuum(%1)").arg(m_vacuum_pages));
+
+    info.insert("success", true);
+    info.insert("moved", moved);
+    info.insert("total_moved", m_total_moved);
+    info.insert("over_size", over_size);
+    info.insert("size_bytes", pragmaValue("page_count") * page_size);
+    PLOG(lcDb, 1) << "[Retention::step]" << m_table << info;
+    return info;
+}
+
+/* Switches the database to auto_vacuum=INCREMENTAL. This needs one full
+ * VACUUM, which rewrites the whole file, so it is only done on request.
+ */
+QVariantMap Retention::vacuum() {
+    PLOG(lcDb, 1) << "[Retention::vacuum]" << m_table;
+    QVariantMap result;
+    if (!m_database) return result;
+    if (m_archive_attached) {
+        m_database->run("DETACH DATABASE archive");
+        m_archive_attached = false;
+    }
+    m_database->run("PRAGMA auto_vacuum=INCREMENTAL");
+    result = m_database->run("VACUUM");
+    result.insert("auto_vacuum", pragmaValue("auto_vacuum"));
+    return result;
+}
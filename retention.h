@@ -0,0 +1,87 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef RETENTION_H
+#define RETENTION_H
+
+#include <QObject>
+#include <QTimer>
+#include <QVariantMap>
+#include <QPointer>
+
+#include "database.h"
+
+extern QString jail_working_path;
+
+class JsApi;
+
+/* Keeps a history table of a Database within age and size limits. While
+ * the user is idle, old rows are moved in small batches into an archive
+ * database file (or deleted if no archive is configured), and the freed
+ * pages are returned to the file system with incremental_vacuum, so no
+ * step blocks the GUI thread for long.
+ */
+class Retention : public QObject
+{
+    Q_OBJECT
+public:
+    explicit Retention(JsApi *parent, Database *database, QVariantMap config);
+    ~Retention();
+
+private:
+    JsApi *m_jsApi;
+    QPointer<Database> m_database;
+    QTimer *m_timer;
+
+    QString m_table;
+    QString m_time_column;
+    QString m_time_unit;
+    double m_max_age_days;
+    double m_max_size_mb;
+    QString m_archive_path;
+    int m_batch_size;
+    double m_idle_seconds;
+    int m_vacuum_pages;
+
+    bool m_archive_attached;
+    qint64 m_total_moved;
+
+    // methods
+    qint64 pragmaValue(QString pragma);
+    bool attachArchive();
+
+signals:
+    void progress(QVariantMap info);
+    void error(QVariantMap errors);
+
+private slots:
+    void onTimeout();
+
+public slots:
+    void start();
+    void stop();
+    QVariantMap step();
+    QVariantMap status();
+    QVariantMap vacuum();
+};
+
+#endif // RETENTION_H
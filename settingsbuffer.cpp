@@ -0,0 +1,103 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "settingsbuffer.h"
+#include "logging.h"
+
+#include <QThread>
+#include <QMutexLocker>
+
+#define SETTINGSBUFFER_DELAY 1000
+
+SettingsBuffer::SettingsBuffer(QSettings *settings, QObject *parent) :
+    QObject(parent)
+{
+    m_settings = settings;
+    m_timer = new QTimer(this);
+    m_timer->setSingleShot(true);
+    m_timer->setInterval(SETTINGSBUFFER_DELAY);
+    connect(m_timer, &QTimer::timeout, this, &SettingsBuffer::sync);
+}
+
+SettingsBuffer::~SettingsBuffer() {
+    sync();
+}
+
+QVariant SettingsBuffer::value(const QString &key, const QVariant &default_value) {
+    QMutexLocker locker(&m_mutex);
+    if (m_pending.contains(key)) return m_pending.value(key);
+    if (m_removed.contains(key)) return default_value;
+    return m_settings->value(key, default_value);
+}
+
+bool SettingsBuffer::contains(const QString &key) {
+    QMutexLocker locker(&m_mutex);
+    if (m_pending.contains(key)) return true;
+    if (m_removed.contains(key)) return false;
+    return m_settings->contains(key);
+}
+
+void SettingsBuffer::setValue(const QString &key, const QVariant &value) {
+    {
+        QMutexLocker locker(&m_mutex);
+        m_removed.remove(key);
+        m_pending.insert(key, value);
+    }
+    schedule();
+}
+
+void SettingsBuffer::remove(const QString &key) {
+    {
+        QMutexLocker locker(&m_mutex);
+        m_pending.remove(key);
+        m_removed.insert(key);
+    }
+    schedule();
+}
+
+/* The timer is not restarted by further writes, so pending values are
+ * written at the latest SETTINGSBUFFER_DELAY ms after the first one.
+ */
+void SettingsBuffer::schedule() {
+    if (QThread::currentThread() != thread()) {
+        QMetaObject::invokeMethod(this, "sync", Qt::QueuedConnection);
+        return;
+    }
+    if (!m_timer->isActive()) m_timer->start();
+}
+
+void SettingsBuffer::sync() {
+    m_timer->stop();
+    QMutexLocker locker(&m_mutex);
+    if (!m_pending.isEmpty() || !m_removed.isEmpty()) {
+        PLOG(lcApp, 2) << "[SettingsBuffer::sync]" << m_pending.keys() << m_removed.toList();
+    }
+    foreach (QString key, m_removed) m_settings->remove(key);
+    QMapIterator<QString, QVariant> it(m_pending);
+    while (it.hasNext()) {
+        it.next();
+        m_settings->setValue(it.key(), it.value());
+    }
+    m_pending.clear();
+    m_removed.clear();
+    m_settings->sync();
+}
@@ -0,0 +1,70 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SETTINGSBUFFER_H
+#define SETTINGSBUFFER_H
+
+#include <QObject>
+#include <QSettings>
+#include <QTimer>
+#include <QMutex>
+#include <QMap>
+#include <QSet>
+#include <QVariant>
+
+/* Write-back layer over the global QSettings. Writes are kept in memory,
+ * repeated writes to a key are merged, and the pending values are written
+ * to the INI file at most every SETTINGSBUFFER_DELAY ms, so that e.g. a
+ * window drag does not write the file on every move event. Reads see the
+ * pending values. sync() writes immediately; use it after critical keys
+ * and before exiting (Javascript: setConfiguration with sync, or
+ * syncConfiguration).
+ */
+class SettingsBuffer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit SettingsBuffer(QSettings *settings, QObject *parent = 0);
+    ~SettingsBuffer();
+
+    QVariant value(const QString &key, const QVariant &default_value = QVariant());
+    bool contains(const QString &key);
+    void setValue(const QString &key, const QVariant &value);
+    void remove(const QString &key);
+
+private:
+    QSettings *m_settings;
+    QTimer *m_timer;
+    QMutex m_mutex;
+    QMap<QString, QVariant> m_pending;
+    QSet<QString> m_removed;
+
+    // methods
+    void schedule();
+
+public slots:
+    void sync();
+};
+
+extern SettingsBuffer *settings_buffer;
+
+#endif // SETTINGSBUFFER_H
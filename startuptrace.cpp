@@ -0,0 +1,104 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "startuptrace.h"
+#include "logging.h"
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QCoreApplication>
+
+bool StartupTrace::s_recording = false;
+QString StartupTrace::s_path;
+QElapsedTimer StartupTrace::s_timer;
+QList<StartupTrace::Event> StartupTrace::s_events;
+
+void StartupTrace::start() {
+    s_timer.start();
+    s_recording = true;
+    begin("startup");
+}
+
+void StartupTrace::setEnabled(bool enabled, QString path) {
+    s_path = path;
+    if (!enabled) {
+        s_recording = false;
+        s_events.clear();
+    }
+}
+
+void StartupTrace::record(QString name, char phase) {
+    if (!s_recording) return;
+    Event event;
+    event.name = name;
+    event.phase = phase;
+    event.ts = s_timer.nsecsElapsed() / 1000;
+    s_events.append(event);
+}
+
+void StartupTrace::begin(QString name) {
+    record(name, 'B');
+}
+
+void StartupTrace::end(QString name) {
+    record(name, 'E');
+}
+
+void StartupTrace::mark(QString name) {
+    record(name, 'i');
+}
+
+void StartupTrace::write() {
+    if (!s_recording) return;
+    end("startup");
+    s_recording = false;
+
+    QJsonArray events;
+    qint64 pid = QCoreApplication::applicationPid();
+    foreach (Event event, s_events) {
+        QJsonObject obj;
+        obj.insert("name", event.name);
+        obj.insert("cat", QString("startup"));
+        obj.insert("ph", QString(QChar(event.phase)));
+        obj.insert("ts", (double)event.ts);
+        obj.insert("pid", (double)pid);
+        obj.insert("tid", 1);
+        if (event.phase == 'i') obj.insert("s", QString("g"));
+        events.append(obj);
+    }
+    s_events.clear();
+
+    QJsonObject root;
+    root.insert("traceEvents", events);
+    root.insert("displayTimeUnit", QString("ms"));
+
+    QFile f(s_path);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        PLOG(lcApp, 0) << "[StartupTrace::write] cannot write" << s_path;
+        return;
+    }
+    f.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+    f.close();
+    PLOG(lcApp, 0) << "[StartupTrace::write] wrote" << s_path;
+}
@@ -0,0 +1,71 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef STARTUPTRACE_H
+#define STARTUPTRACE_H
+
+#include <QString>
+#include <QList>
+#include <QElapsedTimer>
+
+/* Records the phases of startup and writes them as a Chrome trace file
+ * (chrome://tracing, Perfetto). Recording starts at the top of main(),
+ * before the settings are known; setEnabled(false) discards it. The file
+ * is written once, when the application page has loaded, when JavaScript
+ * calls API.traceMark(name, true), or at exit. GUI thread only.
+ */
+class StartupTrace
+{
+public:
+    static void start();
+    static void setEnabled(bool enabled, QString path);
+    static void begin(QString name);
+    static void end(QString name);
+    static void mark(QString name);
+    static void write();
+
+    // records a phase for the lifetime of the object
+    class Scope
+    {
+    public:
+        explicit Scope(QString name) : m_name(name) { begin(m_name); }
+        ~Scope() { end(m_name); }
+    private:
+        QString m_name;
+    };
+
+private:
+    struct Event {
+        QString name;
+        char phase;
+        qint64 ts;
+    };
+
+    static void record(QString name, char phase);
+
+    static bool s_recording;
+    static QString s_path;
+    static QElapsedTimer s_timer;
+    static QList<Event> s_events;
+};
+
+#endif // STARTUPTRACE_H
@@ -21,31 +21,32 @@
  */
 
 #include "tcpserver.h"
+#include "logging.h"
 
 TcpServer::TcpServer(QObject *parent) :
     QTcpServer(parent)
 {
-    qDebug() << "Level5 [TcpServer] created";
+    PLOG(lcNet, 5) << "[TcpServer] created";
 }
 
 TcpServer::~TcpServer() {
-    qDebug() << "Level0 [TcpServer::~TcpServer]";
+    PLOG(lcNet, 0) << "[TcpServer::~TcpServer]";
 }
 
 
 bool TcpServer::start(quint16 port) {
     bool success;
     success = listen(QHostAddress::Any, port);
-    qDebug() << "Level5 [TcpServer] listening on port" << port << success;
+    PLOG(lcNet, 5) << "[TcpServer] listening on port" << port << success;
     return success;
 }
 
 void TcpServer::stop() {
-    qDebug() << "Level0 [TcpServer::stop] closing";
+    PLOG(lcNet, 0) << "[TcpServer::stop] closing";
     close();
 }
 
 void TcpServer::incomingConnection(qintptr socketDescriptor) {
-    qDebug() << "Level0 [TcpServer::incomingConnection] Descriptor is" << socketDescriptor;
+    PLOG(lcNet, 0) << "[TcpServer::incomingConnection] Descriptor is" << socketDescriptor;
     emit newSocketDescriptor((int)socketDescriptor);
 }
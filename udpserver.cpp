@@ -1,4 +1,5 @@
 #include "udpserver.h"
+#include "logging.h"
 
 UdpServer::UdpServer(QObject *parent) :
     QUdpSocket(parent)
@@ -9,19 +10,19 @@ UdpServer::UdpServer(QObject *parent) :
 
 
 UdpServer::~UdpServer() {
-    qDebug() << "Level0 [UdpServer::~UdpServer]";
+    PLOG(lcUdp, 0) << "[UdpServer::~UdpServer]";
 }
 
 
 bool UdpServer::start(quint16 port, QAbstractSocket::BindMode bindmode) {
     bool success;
     success = bind(port, bindmode);
-    qDebug() << "Level5 [UdpServer:start] listening on port" << port << success;
+    PLOG(lcUdp, 5) << "[UdpServer:start] listening on port" << port << success;
     return success;
 }
 
 void UdpServer::stop() {
-    qDebug() << "Level0 [UdpServer::stop] closing";
+    PLOG(lcUdp, 0) << "[UdpServer::stop] closing";
     close();
 }
 
@@ -36,7 +37,7 @@ void UdpServer::onReadyRead() {
 }
 
 qint64 UdpServer::sendDatagramFromHex(QString hex, QString host, qint64 port) {
-    qDebug() << "Level2 [UdpServer::sendDatagram] Writing UDP datagram to" << host << port;
+    PLOG(lcUdp, 2) << "[UdpServer::sendDatagram] Writing UDP datagram to" << host << port;
     QByteArray ba = QByteArray::fromHex(hex.toLatin1());
     qint64 bytes_sent = writeDatagram(ba, ba.length(), QHostAddress(host), port);
     return bytes_sent;
@@ -0,0 +1,381 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "unzipper.h"
+#include "logging.h"
+#include "fileutil.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QSet>
+#include <QtEndian>
+#include <QtConcurrent>
+#include <QDebug>
+#include <string.h>
+#include <limits.h>
+
+#ifdef Q_OS_WIN
+#include <QtZlib/zlib.h>
+#else
+#include <zlib.h>
+#endif
+
+#define UNZIPPER_PROGRESS_INTERVAL 250
+#define UNZIPPER_BUFFER 262144
+#define UNZIPPER_MAX_INPUT 1073741824
+
+#define ZIP_EOCD_SIG 0x06054b50
+#define ZIP64_LOCATOR_SIG 0x07064b50
+#define ZIP64_EOCD_SIG 0x06064b50
+#define ZIP_CENTRAL_SIG 0x02014b50
+#define ZIP_LOCAL_SIG 0x04034b50
+
+static inline quint16 rd16(const uchar *p) { return qFromLittleEndian<quint16>(p); }
+static inline quint32 rd32(const uchar *p) { return qFromLittleEndian<quint32>(p); }
+static inline quint64 rd64(const uchar *p) { return qFromLittleEndian<quint64>(p); }
+
+struct ExtractEntryFunctor
+{
+    typedef void result_type;
+    Unzipper *m_unzipper;
+    explicit ExtractEntryFunctor(Unzipper *unzipper) : m_unzipper(unzipper) {}
+    void operator()(const Unzipper::Entry &entry) { m_unzipper->extractEntry(entry); }
+};
+
+Unzipper::Unzipper(QObject *parent, QString zip_abs, QString dst_abs) :
+    QObject(parent),
+    m_file(zip_abs)
+{
+    PLOG(lcFs, 1) << "[Unzipper::Unzipper]" << zip_abs << dst_abs;
+    m_zip_abs = zip_abs;
+    m_dst_abs = QDir(dst_abs).absolutePath();
+    m_map = NULL;
+    m_size = 0;
+    m_bytes_total = 0;
+    m_skipped = 0;
+    m_cancelled = 0;
+    // error() is emitted from a pool thread
+    qRegisterMetaType<QProcess::ProcessError>("QProcess::ProcessError");
+}
+
+/* Like DirCopier, a running extraction is cancelled and waited for.
+ */
+Unzipper::~Unzipper() {
+    PLOG(lcFs, 1) << "[Unzipper::~Unzipper]" << m_zip_abs;
+    cancel();
+    m_future.waitForFinished();
+    if (m_map) m_file.unmap(m_map);
+}
+
+void Unzipper::cancel() {
+    m_cancelled = 1;
+}
+
+/* Fills m_entries and m_dirs. Returns an empty string on success,
+ * otherwise the error info.
+ */
+QString Unzipper::readCentralDirectory() {
+    m_entries.clear();
+    m_dirs.clear();
+    m_bytes_total = 0;
+    m_skipped = 0;
+
+    if (m_size < 22) return "zipInvalid";
+    qint64 eocd = -1;
+    for (qint64 pos = m_size - 22; pos >= qMax((qint64)0, m_size - 22 - 65535); pos--) {
+        if (rd32(m_map + pos) == ZIP_EOCD_SIG) {
+            eocd = pos;
+            break;
+        }
+    }
+    if (eocd < 0) return "zipInvalid";
+
+    qint64 count = rd16(m_map + eocd + 10);
+    qint64 cd_size = rd32(m_map + eocd + 12);
+    qint64 cd_offset = rd32(m_map + eocd + 16);
+
+    if ((count == 0xFFFF || cd_size == 0xFFFFFFFF || cd_offset == 0xFFFFFFFF) && eocd >= 20 && rd32(m_map + eocd - 20) == ZIP64_LOCATOR_SIG) {
+        qint64 eocd64 = rd64(m_map + eocd - 20 + 8);
+        if (eocd64 < 0 || eocd64 > m_size - 56 || rd32(m_map + eocd64) != ZIP64_EOCD_SIG) return "zipInvalid";
+        count = rd64(m_map + eocd64 + 32);
+        cd_size = rd64(m_map + eocd64 + 40);
+        cd_offset = rd64(m_map + eocd64 + 48);
+    }
+    // offsets and sizes come from the archive: compare by subtraction, so
+    // that values near INT64_MAX cannot overflow past the checks
+    if (cd_offset < 0 || cd_size < 0 || cd_offset > m_size || cd_size > m_size - cd_offset) return "zipInvalid";
+
+    qint64 p = cd_offset;
+    for (qint64 i = 0; i < count; i++) {
+        if (p + 46 > m_size || rd32(m_map + p) != ZIP_CENTRAL_SIG) return "zipInvalid";
+        const uchar *h = m_map + p;
+        quint16 made_by = rd16(h + 4);
+        quint16 flags = rd16(h + 8);
+        quint16 dos_time = rd16(h + 12);
+        quint16 dos_date = rd16(h + 14);
+        quint16 name_len = rd16(h + 28);
+        quint16 extra_len = rd16(h + 30);
+        quint16 comment_len = rd16(h + 32);
+        quint32 ext_attr = rd32(h + 38);
+        if (p + 46 + name_len + extra_len + comment_len > m_size) return "zipInvalid";
+
+        Entry entry;
+        entry.method = rd16(h + 10);
+        entry.crc = rd32(h + 16);
+        entry.compressed_size = rd32(h + 20);
+        entry.size = rd32(h + 24);
+        entry.local_offset = rd32(h + 42);
+
+        // Zip64 extended information replaces the saturated fields, in order
+        const uchar *x = h + 46 + name_len;
+        const uchar *x_end = x + extra_len;
+        while (x + 4 <= x_end) {
+            quint16 id = rd16(x);
+            quint16 len = rd16(x + 2);
+            const uchar *v = x + 4;
+            const uchar *v_end = qMin(v + len, x_end);
+            if (id == 0x0001) {
+                if (entry.size == 0xFFFFFFFF && v + 8 <= v_end) { entry.size = rd64(v); v += 8; }
+                if (entry.compressed_size == 0xFFFFFFFF && v + 8 <= v_end) { entry.compressed_size = rd64(v); v += 8; }
+                if (entry.local_offset == 0xFFFFFFFF && v + 8 <= v_end) { entry.local_offset = rd64(v); v += 8; }
+            }
+            x += 4 + len;
+        }
+
+        QByteArray raw_name((const char *)h + 46, name_len);
+        QString name = (flags & 0x0800) ? QString::fromUtf8(raw_name) : QString::fromLatin1(raw_name);
+        name.replace('\\', '/');
+        p += 46 + name_len + extra_len + comment_len;
+
+        if (name.isEmpty() || name.startsWith("/") || name.contains("..") || (name.length() > 1 && name.at(1) == ':')) {
+            PLOG(lcFs, 0) << "[Unzipper::readCentralDirectory] path not allowed" << name;
+            return "pathNotAllowed";
+        }
+        if (flags & 0x0001) return "encryptedNotSupported";
+
+        if (name.endsWith("/")) {
+            m_dirs.append(name);
+            continue;
+        }
+        if ((made_by >> 8) == 3 && ((ext_attr >> 16) & 0170000) == 0120000) {
+            PLOG(lcFs, 1) << "[Unzipper::readCentralDirectory] skipping symlink" << name;
+            m_skipped++;
+            continue;
+        }
+        if (entry.method != 0 && entry.method != 8) return "methodNotSupported";
+        if (entry.size < 0 || entry.compressed_size < 0 || entry.local_offset < 0) return "zipInvalid";
+        if (entry.compressed_size > m_size || entry.local_offset > m_size) return "zipInvalid";
+        if (entry.method == 0 && entry.size > m_size) return "zipInvalid";
+        if (entry.size > LLONG_MAX - m_bytes_total) return "zipInvalid";
+
+        entry.path_rel = name;
+        entry.mtime = QDateTime(QDate(1980 + (dos_date >> 9), (dos_date >> 5) & 15, dos_date & 31),
+                                QTime(dos_time >> 11, (dos_time >> 5) & 63, (dos_time & 31) * 2));
+        m_entries.append(entry);
+        m_bytes_total += entry.size;
+    }
+    return "";
+}
+
+/* Writes the uncompressed data of entry to out and verifies size and CRC.
+ * Called concurrently from pool threads.
+ */
+bool Unzipper::extractData(const Entry &entry, QFile &out) {
+    qint64 header = entry.local_offset;
+    if (header > m_size - 30 || rd32(m_map + header) != ZIP_LOCAL_SIG) return false;
+    qint64 data_offset = header + 30 + rd16(m_map + header + 26) + rd16(m_map + header + 28);
+    if (data_offset > m_size || entry.compressed_size > m_size - data_offset) return false;
+    const uchar *data = m_map + data_offset;
+
+    uLong crc = crc32(0L, Z_NULL, 0);
+    qint64 written = 0;
+
+    if (entry.method == 0) {
+        if (entry.compressed_size != entry.size) return false;
+        while (written < entry.size) {
+            if (m_cancelled.load()) return false;
+            qint64 chunk = qMin((qint64)UNZIPPER_BUFFER, entry.size - written);
+            crc = crc32(crc, data + written, (uInt)chunk);
+            if (out.write((const char *)data + written, chunk) != chunk) return false;
+            written += chunk;
+        }
+    } else {
+        z_stream zs;
+        memset(&zs, 0, sizeof(zs));
+        if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) return false;
+
+        QByteArray buf;
+        buf.resize((int)qBound((qint64)1, entry.size, (qint64)UNZIPPER_BUFFER));
+        qint64 consumed = 0;
+        bool ok = false;
+        while (!m_cancelled.load()) {
+            if (zs.avail_in == 0) {
+                qint64 chunk = qMin((qint64)UNZIPPER_MAX_INPUT, entry.compressed_size - consumed);
+                if (chunk <= 0) break; // truncated stream
+                zs.next_in = (Bytef *)(data + consumed);
+                zs.avail_in = (uInt)chunk;
+                consumed += chunk;
+            }
+            zs.next_out = (Bytef *)buf.data();
+            zs.avail_out = (uInt)buf.size();
+            int ret = inflate(&zs, Z_NO_FLUSH);
+            if (ret != Z_OK && ret != Z_STREAM_END) break;
+            qint64 produced = buf.size() - zs.avail_out;
+            if (written + produced > entry.size) break;
+            crc = crc32(crc, (const Bytef *)buf.constData(), (uInt)produced);
+            if (out.write(buf.constData(), produced) != produced) break;
+            written += produced;
+            if (ret == Z_STREAM_END) {
+                ok = true;
+                break;
+            }
+        }
+        inflateEnd(&zs);
+        if (!ok) return false;
+    }
+    return written == entry.size && crc == entry.crc;
+}
+
+/* Called concurrently from pool threads.
+ */
+void Unzipper::extractEntry(const Entry &entry) {
+    if (m_cancelled.load()) return;
+
+    QFile out(m_dst_abs + "/" + entry.path_rel);
+    bool ok = out.open(QIODevice::WriteOnly) && extractData(entry, out);
+    out.close();
+    if (ok) {
+        if (entry.mtime.isValid()) FileUtil::setModificationTime(out.fileName(), entry.mtime);
+    } else {
+        if (!m_cancelled.load()) {
+            PLOG(lcFs, 0) << "[Unzipper::extractEntry] cannot extract" << entry.path_rel;
+            m_failed.fetchAndAddOrdered(1);
+        }
+        out.remove();
+    }
+
+    qint64 files_done = m_files_done.fetchAndAddOrdered(1) + 1;
+    qint64 bytes_done = m_bytes_done.fetchAndAddOrdered(entry.size) + entry.size;
+    qint64 now = m_timer.elapsed();
+    qint64 last = m_lastProgress.load();
+    if (now - last >= UNZIPPER_PROGRESS_INTERVAL && m_lastProgress.testAndSetOrdered(last, now)) {
+        emit progress(files_done, m_entries.length(), bytes_done, m_bytes_total);
+    }
+}
+
+/* Extracts synchronously. The entries are still inflated in parallel;
+ * the calling thread takes part in the work.
+ */
+QVariantMap Unzipper::exec() {
+    QVariantMap info;
+    m_timer.start();
+    m_files_done = 0;
+    m_bytes_done = 0;
+    m_failed = 0;
+    m_lastProgress = 0;
+
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        info.insert("status", "Error");
+        info.insert("info", "zipCannotOpen");
+        info.insert("stdout", "");
+        info.insert("stderr", "cannot find or open " + m_zip_abs + "\n");
+        return info;
+    }
+    m_size = m_file.size();
+    m_map = m_file.map(0, m_size);
+    if (!m_map) {
+        m_file.close();
+        info.insert("status", "Error");
+        info.insert("info", "zipCannotMap");
+        info.insert("stdout", "");
+        info.insert("stderr", "cannot map " + m_zip_abs + "\n");
+        return info;
+    }
+
+    QString error = readCentralDirectory();
+    if (error == "") {
+        QSet<QString> dirs;
+        foreach (QString dir_rel, m_dirs) dirs.insert(dir_rel);
+        foreach (Entry entry, m_entries) dirs.insert(QFileInfo(entry.path_rel).path());
+        QDir().mkpath(m_dst_abs);
+        foreach (QString dir_rel, dirs) {
+            if (!QDir().mkpath(m_dst_abs + "/" + dir_rel)) {
+                PLOG(lcFs, 0) << "[Unzipper::exec] cannot create dir" << dir_rel;
+                error = "cannotCreateDir";
+                break;
+            }
+        }
+    }
+    if (error == "") {
+        QtConcurrent::blockingMap(m_entries, ExtractEntryFunctor(this));
+    }
+
+    m_file.unmap(m_map);
+    m_map = NULL;
+    m_file.close();
+
+    if (error != "") {
+        info.insert("status", "Error");
+        info.insert("info", error);
+    } else if (m_cancelled.load()) {
+        info.insert("status", "Error");
+        info.insert("info", "cancelled");
+    } else if (m_failed.load() > 0) {
+        info.insert("status", "Error");
+        info.insert("info", "extractFailed");
+    } else {
+        info.insert("status", "OK");
+    }
+    info.insert("files", m_entries.length());
+    info.insert("failed", m_failed.load());
+    info.insert("skipped", m_skipped);
+    info.insert("bytes", m_bytes_total);
+    info.insert("ms", m_timer.elapsed());
+
+    QString out = "Archive:  " + m_zip_abs + "\n";
+    if (error == "") {
+        foreach (QString dir_rel, m_dirs) out += "   creating: " + m_dst_abs + "/" + dir_rel + "/\n";
+        foreach (Entry entry, m_entries) out += "  inflating: " + m_dst_abs + "/" + entry.path_rel + "\n";
+    }
+    info.insert("stdout", out);
+    info.insert("stderr", info.value("status") == "OK" ? QString() : info.value("info").toString() + "\n");
+    PLOG(lcFs, 1) << "[Unzipper::exec] done" << m_zip_abs << info.value("status") << info.value("info");
+    return info;
+}
+
+/* An archive that cannot be opened corresponds to unzip failing to
+ * start, so error() precedes finished() in that case.
+ */
+void Unzipper::execAndEmit() {
+    QVariantMap info = exec();
+    QString reason = info.value("info").toString();
+    if (reason == "zipCannotOpen" || reason == "zipCannotMap") emit error(QProcess::FailedToStart);
+    emit finished(info);
+}
+
+/* Extracts in the background; the result is delivered by finished().
+ */
+void Unzipper::run() {
+    if (m_future.isRunning()) return;
+    emit started();
+    m_future = QtConcurrent::run(this, &Unzipper::execAndEmit);
+}
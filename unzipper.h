@@ -0,0 +1,104 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef UNZIPPER_H
+#define UNZIPPER_H
+
+#include <QObject>
+#include <QProcess>
+#include <QFile>
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QVariantMap>
+#include <QList>
+#include <QFuture>
+
+/* Extracts a zip archive in-process. The archive is memory-mapped, its
+ * central directory is read once, and the entries are then inflated in
+ * parallel on the global QThreadPool, each one checked against its CRC.
+ * Stored and deflated entries and Zip64 archives are supported;
+ * encrypted entries and symbolic links are not.
+ *
+ * The whole archive is rejected before anything is written if one entry
+ * name is absolute or contains "..". Existing files are overwritten.
+ *
+ * For callers written against the ProcessManager running unzip, which
+ * this replaces, started() and error() are emitted as well, and the info
+ * of finished() carries "stdout" (an unzip-like listing) and "stderr".
+ */
+class Unzipper : public QObject
+{
+    Q_OBJECT
+public:
+    explicit Unzipper(QObject *parent, QString zip_abs, QString dst_abs);
+    ~Unzipper();
+
+    struct Entry {
+        QString path_rel;
+        quint16 method;
+        quint32 crc;
+        qint64 compressed_size;
+        qint64 size;
+        qint64 local_offset;
+        QDateTime mtime;
+    };
+
+    QVariantMap exec();
+    void extractEntry(const Entry &entry);
+
+private:
+    QString m_zip_abs;
+    QString m_dst_abs;
+    QFile m_file;
+    uchar *m_map;
+    qint64 m_size;
+    QList<Entry> m_entries;
+    QStringList m_dirs;
+    qint64 m_bytes_total;
+    qint64 m_skipped;
+    QAtomicInt m_cancelled;
+    QAtomicInteger<qint64> m_files_done;
+    QAtomicInteger<qint64> m_bytes_done;
+    QAtomicInteger<qint64> m_failed;
+    QAtomicInteger<qint64> m_lastProgress;
+    QElapsedTimer m_timer;
+    QFuture<void> m_future;
+
+    // methods
+    QString readCentralDirectory();
+    bool extractData(const Entry &entry, QFile &out);
+    void execAndEmit();
+
+signals:
+    void started();
+    void progress(qint64 files_done, qint64 files_total, qint64 bytes_done, qint64 bytes_total);
+    void finished(QVariantMap info);
+    void error(QProcess::ProcessError err);
+
+public slots:
+    void run();
+    void cancel();
+};
+
+#endif // UNZIPPER_H
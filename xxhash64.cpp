@@ -0,0 +1,149 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "xxhash64.h"
+
+#include <string.h>
+
+static const uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+static const uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t PRIME5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+// little-endian loads, independent of host byte order and alignment
+static inline uint64_t read64(const unsigned char *p) {
+    return (uint64_t)p[0] | ((uint64_t)p[1] << 8) | ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24)
+         | ((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40) | ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+}
+
+static inline uint32_t read32(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t round64(uint64_t acc, uint64_t input) {
+    acc += input * PRIME2;
+    acc = rotl(acc, 31);
+    return acc * PRIME1;
+}
+
+static inline uint64_t mergeRound(uint64_t acc, uint64_t val) {
+    acc ^= round64(0, val);
+    return acc * PRIME1 + PRIME4;
+}
+
+XxHash64::XxHash64(uint64_t seed) {
+    m_seed = seed;
+    reset();
+}
+
+void XxHash64::reset() {
+    m_v1 = m_seed + PRIME1 + PRIME2;
+    m_v2 = m_seed + PRIME2;
+    m_v3 = m_seed;
+    m_v4 = m_seed - PRIME1;
+    m_total = 0;
+    m_buffered = 0;
+}
+
+void XxHash64::addData(const char *data, size_t length) {
+    const unsigned char *p = (const unsigned char *)data;
+    const unsigned char *end = p + length;
+    m_total += length;
+
+    if (m_buffered + length < 32) {
+        memcpy(m_buffer + m_buffered, p, length);
+        m_buffered += length;
+        return;
+    }
+
+    if (m_buffered) {
+        size_t fill = 32 - m_buffered;
+        memcpy(m_buffer + m_buffered, p, fill);
+        m_v1 = round64(m_v1, read64(m_buffer));
+        m_v2 = round64(m_v2, read64(m_buffer + 8));
+        m_v3 = round64(m_v3, read64(m_buffer + 16));
+        m_v4 = round64(m_v4, read64(m_buffer + 24));
+        p += fill;
+        m_buffered = 0;
+    }
+
+    // four independent lanes per 32-byte stripe, which the compiler can
+    // keep in registers and pipeline
+    uint64_t v1 = m_v1, v2 = m_v2, v3 = m_v3, v4 = m_v4;
+    while (p + 32 <= end) {
+        v1 = round64(v1, read64(p));
+        v2 = round64(v2, read64(p + 8));
+        v3 = round64(v3, read64(p + 16));
+        v4 = round64(v4, read64(p + 24));
+        p += 32;
+    }
+    m_v1 = v1; m_v2 = v2; m_v3 = v3; m_v4 = v4;
+
+    if (p < end) {
+        m_buffered = end - p;
+        memcpy(m_buffer, p, m_buffered);
+    }
+}
+
+uint64_t XxHash64::digest() const {
+    uint64_t h;
+    if (m_total >= 32) {
+        h = rotl(m_v1, 1) + rotl(m_v2, 7) + rotl(m_v3, 12) + rotl(m_v4, 18);
+        h = mergeRound(h, m_v1);
+        h = mergeRound(h, m_v2);
+        h = mergeRound(h, m_v3);
+        h = mergeRound(h, m_v4);
+    } else {
+        h = m_seed + PRIME5;
+    }
+    h += m_total;
+
+    const unsigned char *p = m_buffer;
+    const unsigned char *end = m_buffer + m_buffered;
+    while (p + 8 <= end) {
+        h ^= round64(0, read64(p));
+        h = rotl(h, 27) * PRIME1 + PRIME4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        h ^= (uint64_t)read32(p) * PRIME1;
+        h = rotl(h, 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= (*p) * PRIME5;
+        h = rotl(h, 11) * PRIME1;
+        p++;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
@@ -0,0 +1,53 @@
+/*
+ * popcorn (c) 2016 Michael Franzl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef XXHASH64_H
+#define XXHASH64_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Streaming XXH64, a fast non-cryptographic 64-bit checksum for transfer
+ * integrity checks. Produces the same values as the reference
+ * implementation (https://github.com/Cyan4973/xxHash).
+ */
+class XxHash64
+{
+public:
+    explicit XxHash64(uint64_t seed = 0);
+
+    void reset();
+    void addData(const char *data, size_t length);
+    uint64_t digest() const;
+
+private:
+    uint64_t m_seed;
+    uint64_t m_v1;
+    uint64_t m_v2;
+    uint64_t m_v3;
+    uint64_t m_v4;
+    uint64_t m_total;
+    unsigned char m_buffer[32];
+    size_t m_buffered;
+};
+
+#endif // XXHASH64_H